@@ -10,6 +10,7 @@
  */
 
 #include <linux/export.h>
+#include <linux/scatterlist.h>
 #include <linux/mmc/host.h>
 #include <linux/mmc/card.h>
 #include <linux/mmc/sdio.h>
@@ -44,6 +45,7 @@ void sdio_release_host(struct sdio_func *func)
 {
 	BUG_ON(!func);
 	BUG_ON(!func->card);
+	WARN_ON(func->card->host->areq);
 
 	mmc_release_host(func->card->host);
 }
@@ -296,6 +298,16 @@ unsigned int sdio_align_size(struct sdio_func *func, unsigned int sz)
 }
 EXPORT_SYMBOL_GPL(sdio_align_size);
 
+/* Largest transfer a CMD53 request of up to @max_segs sg entries can carry */
+static unsigned int sdio_max_sg_size(struct sdio_func *func,
+				     unsigned int max_segs)
+{
+	struct mmc_host *host = func->card->host;
+
+	max_segs = min_t(unsigned int, host->max_segs, max_segs);
+	return min(host->max_req_size, host->max_seg_size * max_segs);
+}
+
 /* Split an arbitrarily sized data transfer into several
  * IO_RW_EXTENDED commands. */
 static int sdio_io_rw_ext_helper(struct sdio_func *func, int write,
@@ -308,10 +320,11 @@ static int sdio_io_rw_ext_helper(struct sdio_func *func, int write,
 	/* Do the bulk of the transfer using block mode (if supported). */
 	if (func->card->cccr.multi_block && (size > sdio_max_byte_size(func))) {
 		/* Blocks per command is limited by host count, host transfer
-		 * size (we only use a single sg entry) and the maximum for
-		 * IO_RW_EXTENDED of 511 blocks. */
+		 * size (split over as many sg entries as the host takes) and
+		 * the maximum for IO_RW_EXTENDED of 511 blocks. */
 		max_blocks = min(func->card->host->max_blk_count,
-			func->card->host->max_seg_size / func->cur_blksize);
+			sdio_max_sg_size(func, MMC_IO_RW_EXT_MAX_SEGS) /
+			func->cur_blksize);
 		max_blocks = min(max_blocks, 511u);
 
 		while (remainder > func->cur_blksize) {
@@ -352,6 +365,147 @@ static int sdio_io_rw_ext_helper(struct sdio_func *func, int write,
 	return 0;
 }
 
+/**
+ *	sdio_sg_req_size - how much a single asynchronous request can carry
+ *	@func: SDIO function to access
+ *	@size: bytes left to transfer
+ *	@max_segs: scatterlist entries the caller describes the chunk with
+ *
+ *	Returns the number of bytes, at most @size, that the next
+ *	sdio_start_sg_req() of a transfer of @size bytes should move,
+ *	given that none of the @max_segs entries may be bigger than the
+ *	host's max_seg_size.
+ */
+unsigned int sdio_sg_req_size(struct sdio_func *func, unsigned int size,
+			      unsigned int max_segs)
+{
+	struct mmc_host *host = func->card->host;
+	unsigned int max_blocks;
+
+	if (size <= sdio_max_byte_size(func))
+		return size;
+
+	if (!func->card->cccr.multi_block || size < func->cur_blksize)
+		return sdio_max_byte_size(func);
+
+	max_blocks = min(host->max_blk_count,
+			 sdio_max_sg_size(func, max_segs) /
+			 func->cur_blksize);
+	max_blocks = min(max_blocks, 511u);
+
+	return min(size / func->cur_blksize, max_blocks) * func->cur_blksize;
+}
+EXPORT_SYMBOL_GPL(sdio_sg_req_size);
+
+static int sdio_sg_req_err_check(struct mmc_card *card,
+				 struct mmc_async_req *areq)
+{
+	struct sdio_sg_req *req = container_of(areq, struct sdio_sg_req, areq);
+
+	return mmc_io_rw_extended_status(card, &req->cmd, &req->data);
+}
+
+static void sdio_sg_req_complete(struct mmc_async_req *areq, int err)
+{
+	struct sdio_sg_req *req;
+
+	if (!areq)
+		return;
+
+	req = container_of(areq, struct sdio_sg_req, areq);
+	if (req->complete)
+		req->complete(req, err);
+}
+
+/**
+ *	sdio_start_sg_req - start an asynchronous CMD53 transfer
+ *	@func: SDIO function to access
+ *	@req: request to start
+ *
+ *	Starts moving @req->size bytes between the scatterlist @req->sg
+ *	(@req->sg_len entries, mapped for DMA by the host driver) and
+ *	@req->addr of @func, as a single IO_RW_EXTENDED command, and
+ *	returns without waiting for it to finish.
+ *
+ *	Only one request is on the wire at a time: if one is still in
+ *	flight, this waits for it, completes it and then starts @req, so
+ *	callers can build the next request while the previous one is being
+ *	transferred. A request's @complete callback is invoked from the
+ *	context of the sdio_start_sg_req()/sdio_wait_sg_req() call that
+ *	reaps it. If that request failed, @req is not started and the
+ *	error is returned.
+ *
+ *	The host must stay claimed until sdio_wait_sg_req() was called,
+ *	and no other I/O may be done on it in between.
+ *
+ *	@req->size must fit a single command, as told by
+ *	sdio_sg_req_size() for @req->sg_len entries, and no entry may be
+ *	bigger than the host's max_seg_size. Bigger transfers have to be
+ *	split by the caller.
+ */
+int sdio_start_sg_req(struct sdio_func *func, struct sdio_sg_req *req)
+{
+	struct mmc_host *host = func->card->host;
+	struct mmc_async_req *prev;
+	struct scatterlist *sg;
+	unsigned blocks, blksz;
+	int i, ret;
+
+	BUG_ON(!req->sg || !req->sg_len || !req->size);
+
+	if (req->sg_len > host->max_segs ||
+	    sdio_sg_req_size(func, req->size, req->sg_len) != req->size)
+		return -EINVAL;
+
+	for_each_sg(req->sg, sg, req->sg_len, i)
+		if (sg->length > host->max_seg_size)
+			return -EINVAL;
+
+	if (req->size <= sdio_max_byte_size(func)) {
+		blocks = 1;
+		blksz = req->size;
+	} else {
+		blksz = func->cur_blksize;
+		blocks = req->size / blksz;
+	}
+
+	ret = mmc_io_rw_extended_prep(func->card, req->write, func->num,
+				      req->addr, req->incr_addr, blocks, blksz,
+				      &req->mrq, &req->cmd, &req->data);
+	if (ret)
+		return ret;
+
+	req->data.sg = req->sg;
+	req->data.sg_len = req->sg_len;
+	req->areq.mrq = &req->mrq;
+	req->areq.err_check = sdio_sg_req_err_check;
+
+	prev = mmc_start_req(host, &req->areq, &ret);
+	sdio_sg_req_complete(prev, ret);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sdio_start_sg_req);
+
+/**
+ *	sdio_wait_sg_req - finish the in-flight asynchronous CMD53 transfer
+ *	@func: SDIO function the request was started on
+ *
+ *	Waits for the request started last with sdio_start_sg_req(), if
+ *	any, and completes it. Returns its status.
+ */
+int sdio_wait_sg_req(struct sdio_func *func)
+{
+	struct mmc_async_req *prev;
+	int ret;
+
+	prev = mmc_start_req(func->card->host, NULL, &ret);
+	sdio_sg_req_complete(prev, ret);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sdio_wait_sg_req);
+
 /**
  *	sdio_readb - read a single byte from a SDIO function
  *	@func: SDIO function to access
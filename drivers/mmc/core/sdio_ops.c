@@ -118,14 +118,15 @@ int mmc_io_rw_direct(struct mmc_card *card, int write, unsigned fn,
 	return mmc_io_rw_direct_host(card->host, write, fn, addr, in, out);
 }
 
-int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
-	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz)
+/*
+ * Set up a CMD53 request moving @blocks blocks of @blksz bytes; the
+ * caller fills in data->sg/sg_len.
+ */
+int mmc_io_rw_extended_prep(struct mmc_card *card, int write, unsigned fn,
+	unsigned addr, int incr_addr, unsigned blocks, unsigned blksz,
+	struct mmc_request *mrq, struct mmc_command *cmd,
+	struct mmc_data *data)
 {
-	struct mmc_request mrq = {NULL};
-	struct mmc_command cmd = {0};
-	struct mmc_data data = {0};
-	struct scatterlist sg;
-
 	BUG_ON(!card);
 	BUG_ON(fn > 7);
 	BUG_ON(blocks == 1 && blksz > 512);
@@ -136,54 +137,96 @@ int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
 	if (addr & ~0x1FFFF)
 		return -EINVAL;
 
-	mrq.cmd = &cmd;
-	mrq.data = &data;
+	memset(mrq, 0, sizeof(*mrq));
+	memset(cmd, 0, sizeof(*cmd));
+	memset(data, 0, sizeof(*data));
 
-	cmd.opcode = SD_IO_RW_EXTENDED;
-	cmd.arg = write ? 0x80000000 : 0x00000000;
-	cmd.arg |= fn << 28;
-	cmd.arg |= incr_addr ? 0x04000000 : 0x00000000;
-	cmd.arg |= addr << 9;
+	mrq->cmd = cmd;
+	mrq->data = data;
+
+	cmd->opcode = SD_IO_RW_EXTENDED;
+	cmd->arg = write ? 0x80000000 : 0x00000000;
+	cmd->arg |= fn << 28;
+	cmd->arg |= incr_addr ? 0x04000000 : 0x00000000;
+	cmd->arg |= addr << 9;
 	if (blocks == 1 && blksz < 512)
-		cmd.arg |= blksz;			/* byte mode */
+		cmd->arg |= blksz;			/* byte mode */
 	else if (blocks == 1 && blksz == 512 &&
 		 !(mmc_card_broken_byte_mode_512(card)))
-		cmd.arg |= 0;				/* byte mode, 0==512 */
+		cmd->arg |= 0;				/* byte mode, 0==512 */
 	else
-		cmd.arg |= 0x08000000 | blocks;		/* block mode */
-	cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
-
-	data.blksz = blksz;
-	data.blocks = blocks;
-	data.flags = write ? MMC_DATA_WRITE : MMC_DATA_READ;
-	data.sg = &sg;
-	data.sg_len = 1;
+		cmd->arg |= 0x08000000 | blocks;	/* block mode */
+	cmd->flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
 
-	sg_init_one(&sg, buf, blksz * blocks);
+	data->blksz = blksz;
+	data->blocks = blocks;
+	data->flags = write ? MMC_DATA_WRITE : MMC_DATA_READ;
 
-	mmc_set_data_timeout(&data, card);
+	mmc_set_data_timeout(data, card);
 
-	mmc_wait_for_req(card->host, &mrq);
+	return 0;
+}
 
-	if (cmd.error)
-		return cmd.error;
-	if (data.error)
-		return data.error;
+/* Result of a completed CMD53 request */
+int mmc_io_rw_extended_status(struct mmc_card *card,
+	struct mmc_command *cmd, struct mmc_data *data)
+{
+	if (cmd->error)
+		return cmd->error;
+	if (data->error)
+		return data->error;
 
 	if (mmc_host_is_spi(card->host)) {
 		/* host driver already reported errors */
 	} else {
-		if (cmd.resp[0] & R5_ERROR)
+		if (cmd->resp[0] & R5_ERROR)
 			return -EIO;
-		if (cmd.resp[0] & R5_FUNCTION_NUMBER)
+		if (cmd->resp[0] & R5_FUNCTION_NUMBER)
 			return -EINVAL;
-		if (cmd.resp[0] & R5_OUT_OF_RANGE)
+		if (cmd->resp[0] & R5_OUT_OF_RANGE)
 			return -ERANGE;
 	}
 
 	return 0;
 }
 
+int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
+	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz)
+{
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_data data;
+	struct scatterlist sg[MMC_IO_RW_EXT_MAX_SEGS], *sg_ptr;
+	unsigned int seg_size = card->host->max_seg_size;
+	unsigned int left = blksz * blocks;
+	unsigned int nents, i;
+	int ret;
+
+	/* Let the host DMA more than max_seg_size in a single command */
+	nents = DIV_ROUND_UP(left, seg_size);
+	if (nents > min_t(unsigned int, card->host->max_segs,
+			  MMC_IO_RW_EXT_MAX_SEGS))
+		return -EINVAL;
+
+	ret = mmc_io_rw_extended_prep(card, write, fn, addr, incr_addr,
+				      blocks, blksz, &mrq, &cmd, &data);
+	if (ret)
+		return ret;
+
+	sg_init_table(sg, nents);
+	for_each_sg(sg, sg_ptr, nents, i) {
+		sg_set_buf(sg_ptr, buf + i * seg_size, min(seg_size, left));
+		left -= min(seg_size, left);
+	}
+
+	data.sg = sg;
+	data.sg_len = nents;
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	return mmc_io_rw_extended_status(card, &cmd, &data);
+}
+
 int sdio_reset(struct mmc_host *host)
 {
 	int ret;
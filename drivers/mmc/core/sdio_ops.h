@@ -12,11 +12,20 @@
 #ifndef _MMC_SDIO_OPS_H
 #define _MMC_SDIO_OPS_H
 
+/* Most sg entries mmc_io_rw_extended() splits a buffer into */
+#define MMC_IO_RW_EXT_MAX_SEGS	8
+
 int mmc_send_io_op_cond(struct mmc_host *host, u32 ocr, u32 *rocr);
 int mmc_io_rw_direct(struct mmc_card *card, int write, unsigned fn,
 	unsigned addr, u8 in, u8* out);
 int mmc_io_rw_extended(struct mmc_card *card, int write, unsigned fn,
 	unsigned addr, int incr_addr, u8 *buf, unsigned blocks, unsigned blksz);
+int mmc_io_rw_extended_prep(struct mmc_card *card, int write, unsigned fn,
+	unsigned addr, int incr_addr, unsigned blocks, unsigned blksz,
+	struct mmc_request *mrq, struct mmc_command *cmd,
+	struct mmc_data *data);
+int mmc_io_rw_extended_status(struct mmc_card *card,
+	struct mmc_command *cmd, struct mmc_data *data);
 int sdio_reset(struct mmc_host *host);
 
 #endif
@@ -12,10 +12,14 @@
  * TODO:
  * - Add TSF sync and fix IBSS beacon transmission by adding
  *   competition for "air time" at TBTT
- * - RX filtering based on filter configuration (data->rx_filter)
+ * - RX filtering of multicast frames based on filter configuration
+ *   (data->rx_filter)
  */
 
 #include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/hrtimer.h>
+#include <linux/netdevice.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <net/dst.h>
@@ -47,6 +51,11 @@ static bool fake_hw_scan;
 module_param(fake_hw_scan, bool, 0444);
 MODULE_PARM_DESC(fake_hw_scan, "Install fake (no-op) hw-scan handler");
 
+static bool napi_rx;
+module_param(napi_rx, bool, 0444);
+MODULE_PARM_DESC(napi_rx, "Throughput mode: deliver frames through a "
+		 "per-radio ring and NAPI instead of ieee80211_rx_irqsafe()");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -284,9 +293,21 @@ static const struct ieee80211_rate hwsim_rates[] = {
 	{ .bitrate = 540 }
 };
 
+/*
+ * hwsim_radio_lock serializes changes to hwsim_radios, the TX path
+ * walks the list under RCU.
+ */
 static spinlock_t hwsim_radio_lock;
 static struct list_head hwsim_radios;
 
+#define HWSIM_RX_RING_LEN	1024
+#define HWSIM_NAPI_WEIGHT	64
+#define HWSIM_AIRTIME_BACKLOG	(2 * NSEC_PER_MSEC)
+#define HWSIM_PREAMBLE_NS	(20 * NSEC_PER_USEC)
+
+/* log2 buckets of the delivery latency in usecs */
+#define HWSIM_LATENCY_BUCKETS	24
+
 struct mac80211_hwsim_data {
 	struct list_head list;
 	struct ieee80211_hw *hw;
@@ -320,6 +341,42 @@ struct mac80211_hwsim_data {
 	u64 group;
 	struct dentry *debugfs_group;
 
+	/* percentage of frames from other radios this radio fails to hear */
+	u32 rx_loss;
+	struct dentry *debugfs_rx_loss;
+
+	/*
+	 * Throughput mode (napi_rx): frames from other radios are queued
+	 * on rx_ring, each stamped with the time it is due, and handed to
+	 * mac80211 from NAPI. rx_timer polls again when the head of the
+	 * ring is not due yet.
+	 */
+	struct sk_buff_head rx_ring;
+	struct net_device napi_dev;
+	struct napi_struct napi;
+	struct hrtimer rx_timer;
+
+	/*
+	 * Airtime model: each frame we send occupies the medium for its
+	 * duration at the TX rate, and is only due at the receivers once
+	 * it has been sent. Our queues are stopped while more than
+	 * HWSIM_AIRTIME_BACKLOG is waiting for the medium.
+	 */
+	bool airtime;
+	spinlock_t medium_lock;
+	ktime_t medium_busy;
+	struct hrtimer tx_timer;
+	struct dentry *debugfs_airtime;
+
+	struct hwsim_rx_stats {
+		ktime_t since;
+		u64 delivered;
+		u64 poll_ns;
+		atomic_t ring_drops;
+		u32 latency[HWSIM_LATENCY_BUCKETS];
+	} rx_stats;
+	struct dentry *debugfs_rx_stats;
+
 	int power_level;
 };
 
@@ -595,6 +652,178 @@ nla_put_failure:
 	printk(KERN_DEBUG "mac80211_hwsim: error occured in %s\n", __func__);
 }
 
+/* HT rates in 100 kbps for one stream, 20 MHz and long GI */
+static const u16 hwsim_mcs_rates[] = { 65, 130, 195, 260, 390, 520, 585, 650 };
+
+static u64 mac80211_hwsim_airtime(struct ieee80211_hw *hw,
+				  struct ieee80211_tx_info *info,
+				  unsigned int len)
+{
+	struct ieee80211_tx_rate *txrate = &info->control.rates[0];
+	struct ieee80211_supported_band *sband;
+	u32 rate;
+
+	if (txrate->idx < 0)
+		return HWSIM_PREAMBLE_NS;
+
+	if (txrate->flags & IEEE80211_TX_RC_MCS) {
+		rate = hwsim_mcs_rates[txrate->idx % 8] * (txrate->idx / 8 + 1);
+		if (txrate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+			rate = rate * 27 / 13;
+		if (txrate->flags & IEEE80211_TX_RC_SHORT_GI)
+			rate = rate * 10 / 9;
+	} else {
+		sband = hw->wiphy->bands[info->band];
+		if (!sband || txrate->idx >= sband->n_bitrates)
+			return HWSIM_PREAMBLE_NS;
+		rate = sband->bitrates[txrate->idx].bitrate;
+	}
+
+	if (!rate)
+		return HWSIM_PREAMBLE_NS;
+
+	/* payload and FCS bits at rate * 100 kbps */
+	return HWSIM_PREAMBLE_NS +
+	       div_u64((u64)(len + FCS_LEN) * 8 * 10000000, rate);
+}
+
+/*
+ * When the frame being sent is due at the receivers: right away without
+ * the airtime model, otherwise once the medium is free and the frame has
+ * been on the air for its duration.
+ */
+static ktime_t mac80211_hwsim_tx_due(struct ieee80211_hw *hw,
+				     struct sk_buff *skb)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	ktime_t now = ktime_get(), due;
+	unsigned long flags;
+	s64 backlog;
+
+	if (!data->airtime)
+		return now;
+
+	spin_lock_irqsave(&data->medium_lock, flags);
+
+	due = data->medium_busy;
+	if (due.tv64 < now.tv64)
+		due = now;
+	due = ktime_add_ns(due, mac80211_hwsim_airtime(hw,
+					IEEE80211_SKB_CB(skb), skb->len));
+	data->medium_busy = due;
+
+	backlog = ktime_to_ns(ktime_sub(due, now));
+	if (backlog > HWSIM_AIRTIME_BACKLOG) {
+		/* resume once half of the backlog has gone out */
+		ieee80211_stop_queues(hw);
+		hrtimer_start(&data->tx_timer,
+			      ktime_sub_ns(due, HWSIM_AIRTIME_BACKLOG / 2),
+			      HRTIMER_MODE_ABS);
+	}
+
+	spin_unlock_irqrestore(&data->medium_lock, flags);
+
+	return due;
+}
+
+static enum hrtimer_restart mac80211_hwsim_tx_timer(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, tx_timer);
+
+	ieee80211_wake_queues(data->hw);
+	return HRTIMER_NORESTART;
+}
+
+static bool mac80211_hwsim_rx_ring_add(struct mac80211_hwsim_data *data,
+				       struct sk_buff *skb, ktime_t due)
+{
+	if (skb_queue_len(&data->rx_ring) >= HWSIM_RX_RING_LEN) {
+		atomic_inc(&data->rx_stats.ring_drops);
+		dev_kfree_skb_any(skb);
+		return false;
+	}
+
+	skb->tstamp = due;
+	skb_queue_tail(&data->rx_ring, skb);
+	napi_schedule(&data->napi);
+	return true;
+}
+
+static enum hrtimer_restart mac80211_hwsim_rx_timer(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, rx_timer);
+
+	napi_schedule(&data->napi);
+	return HRTIMER_NORESTART;
+}
+
+static int mac80211_hwsim_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(napi, struct mac80211_hwsim_data, napi);
+	struct hwsim_rx_stats *stats = &data->rx_stats;
+	struct sk_buff *skb;
+	ktime_t start, now, due;
+	unsigned long flags;
+	bool wait = false;
+	int done = 0, bucket;
+	s64 lat;
+
+	start = ktime_get();
+
+	while (done < budget) {
+		now = ktime_get();
+
+		spin_lock_irqsave(&data->rx_ring.lock, flags);
+		skb = skb_peek(&data->rx_ring);
+		if (skb && skb->tstamp.tv64 > now.tv64) {
+			due = skb->tstamp;
+			wait = true;
+			skb = NULL;
+		} else if (skb) {
+			__skb_unlink(skb, &data->rx_ring);
+		}
+		spin_unlock_irqrestore(&data->rx_ring.lock, flags);
+
+		if (!skb)
+			break;
+
+		done++;
+
+		lat = ktime_to_us(ktime_sub(now, skb->tstamp));
+		bucket = min_t(int, fls64(lat), HWSIM_LATENCY_BUCKETS - 1);
+		stats->latency[bucket]++;
+
+		/* the due time is not a receive timestamp */
+		skb->tstamp.tv64 = 0;
+
+		/* other receivers may still share the data, mac80211 writes */
+		skb = skb_unshare(skb, GFP_ATOMIC);
+		if (!skb) {
+			atomic_inc(&stats->ring_drops);
+			continue;
+		}
+
+		ieee80211_rx(data->hw, skb);
+		stats->delivered++;
+	}
+
+	stats->poll_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (done < budget) {
+		napi_complete(napi);
+
+		if (wait)
+			hrtimer_start(&data->rx_timer, due, HRTIMER_MODE_ABS);
+		else if (!skb_queue_empty(&data->rx_ring))
+			napi_schedule(napi);
+	}
+
+	return done;
+}
+
 static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 					  struct sk_buff *skb)
 {
@@ -603,12 +832,15 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_rx_status rx_status;
+	ktime_t due;
 
 	if (data->idle) {
 		wiphy_debug(hw->wiphy, "Trying to TX when idle - reject\n");
 		return false;
 	}
 
+	due = mac80211_hwsim_tx_due(hw, skb);
+
 	memset(&rx_status, 0, sizeof(rx_status));
 	/* TODO: set mactime */
 	rx_status.freq = data->channel->center_freq;
@@ -634,9 +866,10 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 	nf_reset(skb);
 
 	/* Copy skb to all enabled radios that are on the current frequency */
-	spin_lock(&hwsim_radio_lock);
-	list_for_each_entry(data2, &hwsim_radios, list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(data2, &hwsim_radios, list) {
 		struct sk_buff *nskb;
+		bool addr_match;
 
 		if (data == data2)
 			continue;
@@ -648,16 +881,41 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 		    !(data->group & data2->group))
 			continue;
 
-		nskb = skb_copy(skb, GFP_ATOMIC);
+		if (data2->rx_loss && net_random() % 100 < data2->rx_loss)
+			continue;
+
+		/*
+		 * Don't bother copying unicast frames for somebody else
+		 * to a radio that would just drop them.
+		 */
+		addr_match = mac80211_hwsim_addr_match(data2, hdr->addr1);
+		if (!addr_match && !is_multicast_ether_addr(hdr->addr1) &&
+		    !(data2->rx_filter & (FIF_PROMISC_IN_BSS | FIF_OTHER_BSS)))
+			continue;
+
+		/*
+		 * In throughput mode the receivers share the data through
+		 * clones and only copy it in their NAPI poll if it is still
+		 * shared by then.
+		 */
+		if (napi_rx)
+			nskb = skb_clone(skb, GFP_ATOMIC);
+		else
+			nskb = skb_copy(skb, GFP_ATOMIC);
 		if (nskb == NULL)
 			continue;
 
-		if (mac80211_hwsim_addr_match(data2, hdr->addr1))
-			ack = true;
 		memcpy(IEEE80211_SKB_RXCB(nskb), &rx_status, sizeof(rx_status));
-		ieee80211_rx_irqsafe(data2->hw, nskb);
+
+		if (!napi_rx)
+			ieee80211_rx_irqsafe(data2->hw, nskb);
+		else if (!mac80211_hwsim_rx_ring_add(data2, nskb, due))
+			continue;
+
+		if (addr_match)
+			ack = true;
 	}
-	spin_unlock(&hwsim_radio_lock);
+	rcu_read_unlock();
 
 	return ack;
 }
@@ -708,6 +966,11 @@ static int mac80211_hwsim_start(struct ieee80211_hw *hw)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
+	if (napi_rx) {
+		skb_queue_purge(&data->rx_ring);
+		data->medium_busy = ktime_set(0, 0);
+		napi_enable(&data->napi);
+	}
 	data->started = 1;
 	return 0;
 }
@@ -718,6 +981,14 @@ static void mac80211_hwsim_stop(struct ieee80211_hw *hw)
 	struct mac80211_hwsim_data *data = hw->priv;
 	data->started = 0;
 	del_timer(&data->beacon_timer);
+	if (napi_rx) {
+		napi_disable(&data->napi);
+		hrtimer_cancel(&data->rx_timer);
+		hrtimer_cancel(&data->tx_timer);
+		skb_queue_purge(&data->rx_ring);
+		/* don't leave the queues stopped by the airtime model */
+		ieee80211_wake_queues(hw);
+	}
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
 }
 
@@ -860,6 +1131,8 @@ static void mac80211_hwsim_configure_filter(struct ieee80211_hw *hw,
 		data->rx_filter |= FIF_PROMISC_IN_BSS;
 	if (*total_flags & FIF_ALLMULTI)
 		data->rx_filter |= FIF_ALLMULTI;
+	if (*total_flags & FIF_OTHER_BSS)
+		data->rx_filter |= FIF_OTHER_BSS;
 
 	*total_flags = data->rx_filter;
 }
@@ -1209,16 +1482,31 @@ static void mac80211_hwsim_free(void)
 
 	INIT_LIST_HEAD(&tmplist);
 
+	/*
+	 * Stop all radios while they are still on the list, other radios
+	 * may be walking it under RCU until they are unregistered too.
+	 */
+	list_for_each_entry(data, &hwsim_radios, list) {
+		debugfs_remove(data->debugfs_rx_stats);
+		debugfs_remove(data->debugfs_airtime);
+		debugfs_remove(data->debugfs_rx_loss);
+		debugfs_remove(data->debugfs_group);
+		debugfs_remove(data->debugfs_ps);
+		debugfs_remove(data->debugfs);
+		ieee80211_unregister_hw(data->hw);
+	}
+
+	synchronize_rcu();
+
 	spin_lock_bh(&hwsim_radio_lock);
 	list_for_each_safe(i, tmp, &hwsim_radios)
 		list_move(i, &tmplist);
 	spin_unlock_bh(&hwsim_radio_lock);
 
 	list_for_each_entry_safe(data, tmpdata, &tmplist, list) {
-		debugfs_remove(data->debugfs_group);
-		debugfs_remove(data->debugfs_ps);
-		debugfs_remove(data->debugfs);
-		ieee80211_unregister_hw(data->hw);
+		if (napi_rx)
+			netif_napi_del(&data->napi);
+		skb_queue_purge(&data->rx_ring);
 		device_unregister(data->dev);
 		ieee80211_free_hw(data->hw);
 	}
@@ -1400,6 +1688,127 @@ DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_group,
 			hwsim_fops_group_read, hwsim_fops_group_write,
 			"%llx\n");
 
+static int hwsim_fops_rx_loss_read(void *dat, u64 *val)
+{
+	struct mac80211_hwsim_data *data = dat;
+	*val = data->rx_loss;
+	return 0;
+}
+
+static int hwsim_fops_rx_loss_write(void *dat, u64 val)
+{
+	struct mac80211_hwsim_data *data = dat;
+
+	if (val > 100)
+		return -EINVAL;
+	data->rx_loss = val;
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_rx_loss,
+			hwsim_fops_rx_loss_read, hwsim_fops_rx_loss_write,
+			"%llu\n");
+
+static int hwsim_fops_airtime_read(void *dat, u64 *val)
+{
+	struct mac80211_hwsim_data *data = dat;
+	*val = data->airtime;
+	return 0;
+}
+
+static int hwsim_fops_airtime_write(void *dat, u64 val)
+{
+	struct mac80211_hwsim_data *data = dat;
+	data->airtime = !!val;
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_airtime,
+			hwsim_fops_airtime_read, hwsim_fops_airtime_write,
+			"%llu\n");
+
+/* upper bound in usecs of the bucket holding the given fraction */
+static u32 hwsim_latency_percentile(struct hwsim_rx_stats *stats,
+				    u64 total, u32 permille)
+{
+	u64 seen = 0;
+	int i;
+
+	for (i = 0; i < HWSIM_LATENCY_BUCKETS; i++) {
+		seen += stats->latency[i];
+		if (seen * 1000 >= total * permille)
+			break;
+	}
+
+	return i ? 1U << i : 0;
+}
+
+/*
+ * Throughput mode counters since the last write to the file: frames
+ * delivered, frames per second, NAPI time per frame, frames dropped on
+ * a full ring, and delivery latency percentiles beyond the modelled
+ * airtime (log2 bucket upper bounds).
+ */
+static ssize_t hwsim_fops_rx_stats_read(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	struct hwsim_rx_stats *stats = &data->rx_stats;
+	u64 delivered = stats->delivered, elapsed_ms, total = 0;
+	char buf[256];
+	int i, len;
+
+	elapsed_ms = ktime_to_ms(ktime_sub(ktime_get(), stats->since));
+	for (i = 0; i < HWSIM_LATENCY_BUCKETS; i++)
+		total += stats->latency[i];
+
+	len = scnprintf(buf, sizeof(buf),
+			"delivered: %llu\npps: %llu\nns_per_frame: %llu\n"
+			"ring_drops: %d\nlatency_us p50: %u p90: %u p99: %u\n",
+			(unsigned long long)delivered,
+			(unsigned long long)(elapsed_ms ?
+				div64_u64(delivered * 1000, elapsed_ms) : 0),
+			(unsigned long long)(delivered ?
+				div64_u64(stats->poll_ns, delivered) : 0),
+			atomic_read(&stats->ring_drops),
+			hwsim_latency_percentile(stats, total, 500),
+			hwsim_latency_percentile(stats, total, 900),
+			hwsim_latency_percentile(stats, total, 990));
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t hwsim_fops_rx_stats_write(struct file *file,
+					 const char __user *user_buf,
+					 size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	struct hwsim_rx_stats *stats = &data->rx_stats;
+
+	/* the NAPI poll may race with this, good enough for a reset */
+	stats->delivered = 0;
+	stats->poll_ns = 0;
+	atomic_set(&stats->ring_drops, 0);
+	memset(stats->latency, 0, sizeof(stats->latency));
+	stats->since = ktime_get();
+
+	return count;
+}
+
+static int hwsim_fops_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations hwsim_fops_rx_stats = {
+	.read = hwsim_fops_rx_stats_read,
+	.write = hwsim_fops_rx_stats_write,
+	.open = hwsim_fops_open,
+	.llseek = default_llseek,
+};
+
 struct mac80211_hwsim_data *get_hwsim_data_ref_from_addr(
 			     struct mac_address *addr)
 {
@@ -1717,6 +2126,22 @@ static int __init init_mac80211_hwsim(void)
 		data->dev->driver = &mac80211_hwsim_driver;
 		skb_queue_head_init(&data->pending);
 
+		skb_queue_head_init(&data->rx_ring);
+		spin_lock_init(&data->medium_lock);
+		hrtimer_init(&data->rx_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS);
+		data->rx_timer.function = mac80211_hwsim_rx_timer;
+		hrtimer_init(&data->tx_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS);
+		data->tx_timer.function = mac80211_hwsim_tx_timer;
+		data->rx_stats.since = ktime_get();
+		if (napi_rx) {
+			init_dummy_netdev(&data->napi_dev);
+			netif_napi_add(&data->napi_dev, &data->napi,
+				       mac80211_hwsim_napi_poll,
+				       HWSIM_NAPI_WEIGHT);
+		}
+
 		SET_IEEE80211_DEV(hw, data->dev);
 		addr[3] = i >> 8;
 		addr[4] = i;
@@ -1928,11 +2353,26 @@ static int __init init_mac80211_hwsim(void)
 		data->debugfs_group = debugfs_create_file("group", 0666,
 							data->debugfs, data,
 							&hwsim_fops_group);
+		data->debugfs_rx_loss = debugfs_create_file("rx_loss", 0666,
+							data->debugfs, data,
+							&hwsim_fops_rx_loss);
+		if (napi_rx) {
+			data->debugfs_airtime =
+				debugfs_create_file("airtime", 0666,
+						    data->debugfs, data,
+						    &hwsim_fops_airtime);
+			data->debugfs_rx_stats =
+				debugfs_create_file("rx_stats", 0666,
+						    data->debugfs, data,
+						    &hwsim_fops_rx_stats);
+		}
 
 		setup_timer(&data->beacon_timer, mac80211_hwsim_beacon,
 			    (unsigned long) hw);
 
-		list_add_tail(&data->list, &hwsim_radios);
+		spin_lock_bh(&hwsim_radio_lock);
+		list_add_tail_rcu(&data->list, &hwsim_radios);
+		spin_unlock_bh(&hwsim_radio_lock);
 	}
 
 	hwsim_mon = alloc_netdev(0, "hwsim%d", hwsim_mon_setup);
@@ -428,6 +428,7 @@ static struct wlcore_conf wl18xx_conf = {
 		.min_req_tx_blocks            = 45,
 		.min_req_rx_blocks            = 22,
 		.tx_min                       = 27,
+		.tx_adapt_max_blocks          = 16,
 	},
 	.fm_coex = {
 		.enable                       = true,
@@ -1138,8 +1139,14 @@ static int wl18xx_init_vif(struct wl1271* wl, struct wl12xx_vif *wlvif)
 {
 	struct ieee80211_vif *vif = wl12xx_wlvif_to_vif(wlvif);
 
+	/*
+	 * TSO frames are segmented by mac80211 after the 802.11 header is
+	 * built; the checksum of every segment is then offloaded through
+	 * the TX descriptor (see wl18xx_set_tx_desc_csum).
+	 */
 	if (vif)
-		ieee80211_set_netdev_features(vif, NETIF_F_IP_CSUM);
+		ieee80211_set_netdev_features(vif, NETIF_F_IP_CSUM |
+					      NETIF_F_SG | NETIF_F_TSO);
 
 	return 0;
 }
@@ -1271,6 +1278,26 @@ static int wl18xx_get_spare_blocks(struct wl1271 *wl, bool is_gem)
 	return WL18XX_TX_HW_BLOCK_SPARE;
 }
 
+static u32 wl18xx_get_rx_mem_overflows(struct wl1271 *wl)
+{
+	struct wl18xx_acx_statistics *stats = wl->stats.fw_stats;
+
+	if (!stats)
+		return 0;
+
+	return stats->rx.rx_out_of_mem;
+}
+
+static u32 wl18xx_get_rx_filter_drops(struct wl1271 *wl)
+{
+	struct wl18xx_acx_statistics *stats = wl->stats.fw_stats;
+
+	if (!stats)
+		return 0;
+
+	return stats->rx_filter.data_filter;
+}
+
 static int wl18xx_set_key(struct wl1271 *wl, enum set_key_cmd cmd,
 			  struct ieee80211_vif *vif,
 			  struct ieee80211_sta *sta,
@@ -1350,6 +1377,8 @@ static struct wlcore_ops wl18xx_ops = {
 	.debugfs_init	= wl18xx_debugfs_add_files,
 	.handle_static_data	= wl18xx_handle_static_data,
 	.get_spare_blocks = wl18xx_get_spare_blocks,
+	.get_rx_mem_overflows = wl18xx_get_rx_mem_overflows,
+	.get_rx_filter_drops = wl18xx_get_rx_filter_drops,
 	.set_key	= wl18xx_set_key,
 };
 
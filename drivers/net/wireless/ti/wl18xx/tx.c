@@ -28,6 +28,45 @@
 #include "wl18xx.h"
 #include "tx.h"
 
+/*
+ * Fill the TX status rate from the last rate the FW reported for the
+ * link the frame was sent on. The FW doesn't report per-frame retries,
+ * so a successful frame is accounted as a single attempt and a failed
+ * one as having used up the long retry limit.
+ */
+static void wl18xx_tx_set_status_rate(struct wl1271 *wl,
+				      struct ieee80211_tx_info *info,
+				      struct wl1271_tx_hw_descr *desc,
+				      bool tx_success)
+{
+	struct ieee80211_tx_rate *rate = &info->status.rates[0];
+	struct ieee80211_vif *vif = info->control.vif;
+	struct wl12xx_vif *wlvif;
+	struct wl1271_link *lnk = NULL;
+
+	/* info->control is valid as long as we don't update info->status */
+	if (vif && desc->hlid < WL12XX_MAX_LINKS)
+		lnk = &wl->links[desc->hlid];
+
+	rate->idx = -1;
+	rate->flags = 0;
+	rate->count = tx_success ? 1 :
+		      wl->conf.tx.sta_rc_conf.long_retry_limit;
+
+	if (!lnk || !lnk->fw_rate_mbps)
+		return;
+
+	wlvif = wl12xx_vif_to_data(vif);
+
+	rate->idx = wlcore_rate_to_idx(wl, lnk->fw_rate_idx, wlvif->band);
+	if (lnk->fw_rate_idx <= wl->hw_min_ht_rate) {
+		rate->flags |= IEEE80211_TX_RC_MCS;
+		if (wlvif->channel_type == NL80211_CHAN_HT40MINUS ||
+		    wlvif->channel_type == NL80211_CHAN_HT40PLUS)
+			rate->flags |= IEEE80211_TX_RC_40_MHZ_WIDTH;
+	}
+}
+
 static void wl18xx_tx_complete_packet(struct wl1271 *wl, u8 tx_stat_byte)
 {
 	struct ieee80211_tx_info *info;
@@ -53,14 +92,15 @@ static void wl18xx_tx_complete_packet(struct wl1271 *wl, u8 tx_stat_byte)
 		return;
 	}
 
+	/* the TX descriptor is still in front of the frame at this point */
+	wl18xx_tx_set_status_rate(wl, info,
+				  (struct wl1271_tx_hw_descr *)skb->data,
+				  tx_success);
+
 	/* update the TX status info */
 	if (tx_success && !(info->flags & IEEE80211_TX_CTL_NO_ACK))
 		info->flags |= IEEE80211_TX_STAT_ACK;
 
-	/* no real data about Tx completion */
-	info->status.rates[0].idx = -1;
-	info->status.rates[0].count = 0;
-	info->status.rates[0].flags = 0;
 	info->status.ack_signal = -1;
 
 	if (!tx_success)
@@ -269,6 +269,10 @@ void wl12xx_free_link(struct wl1271 *wl, struct wl12xx_vif *wlvif, u8 *hlid)
 	 */
 	wl1271_tx_reset_link_queues(wl, *hlid);
 
+	/* don't hand stale state to the next user of this link */
+	wl->links[*hlid].fw_rate_mbps = 0;
+	memset(&wl->links[*hlid].rx_ba, 0, sizeof(wl->links[*hlid].rx_ba));
+
 	*hlid = WL12XX_INVALID_LINK_ID;
 }
 
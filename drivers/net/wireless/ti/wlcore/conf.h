@@ -1166,6 +1166,14 @@ struct conf_memory_settings {
 	 * Range: 0-120
 	 */
 	u8 tx_min;
+
+	/*
+	 * Maximum number of free TX memory blocks the host holds back for
+	 * RX while the FW reports RX overflows (0 - disabled)
+	 *
+	 * Range: 0 - tx_min
+	 */
+	u8 tx_adapt_max_blocks;
 };
 
 struct conf_fm_coex {
@@ -26,6 +26,7 @@
 #include <linux/skbuff.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/ctype.h>
 
 #include "wlcore.h"
 #include "debug.h"
@@ -35,6 +36,7 @@
 #include "tx.h"
 #include "version.h"
 #include "hw_ops.h"
+#include "rx.h"
 
 /* ms */
 #define WL1271_DEBUGFS_STATS_LIFETIME 1000
@@ -55,10 +57,97 @@ int wl1271_format_buffer(char __user *userbuf, size_t count,
 }
 EXPORT_SYMBOL_GPL(wl1271_format_buffer);
 
+/*
+ * readers fall back to an on-demand refresh once the background snapshot
+ * is older than this many sample intervals, e.g. on an idle link
+ */
+#define WL1271_DEBUGFS_SAMPLE_STALE	3
+
+/*
+ * Take a background statistics sample if the sampler is enabled and the
+ * current snapshot is older than the configured interval. Must be called
+ * with wl->mutex held and the chip awake; no wakeup is forced here.
+ */
+static void wl1271_debugfs_sample_stats(struct wl1271 *wl)
+{
+	struct wl1271_stats *stats = &wl->stats;
+	void *tmp;
+	int ret;
+
+	if (!stats->sample_interval || !stats->fw_stats_prev)
+		return;
+
+	if (wl->state != WL1271_STATE_ON ||
+	    test_bit(WL1271_FLAG_RECOVERY_IN_PROGRESS, &wl->flags))
+		return;
+
+	if (!time_after(jiffies, stats->fw_stats_update +
+			msecs_to_jiffies(stats->sample_interval)))
+		return;
+
+	/* read into the older buffer so readers never see a partial sample */
+	ret = wl1271_acx_statistics(wl, stats->fw_stats_prev);
+	if (ret < 0)
+		return;
+
+	tmp = stats->fw_stats;
+	stats->fw_stats = stats->fw_stats_prev;
+	stats->fw_stats_prev = tmp;
+
+	stats->fw_stats_prev_update = stats->fw_stats_update;
+	stats->fw_stats_update = jiffies;
+}
+
+/* (re)arm the background sampler, must be called with wl->mutex held */
+void wl1271_debugfs_sample_start(struct wl1271 *wl)
+{
+	struct wl1271_stats *stats = &wl->stats;
+
+	if (!stats->sample_interval || !stats->fw_stats_prev ||
+	    wl->state != WL1271_STATE_ON)
+		return;
+
+	cancel_delayed_work(&stats->sample_work);
+	ieee80211_queue_delayed_work(wl->hw, &stats->sample_work,
+				     msecs_to_jiffies(stats->sample_interval));
+}
+
+/*
+ * The sampler only piggybacks on a chip that is already awake. While the
+ * chip sleeps the snapshot ages, and readers refresh it on demand.
+ */
+void wl1271_debugfs_sample_work(struct work_struct *work)
+{
+	struct delayed_work *dwork;
+	struct wl1271_stats *stats;
+	struct wl1271 *wl;
+
+	dwork = container_of(work, struct delayed_work, work);
+	stats = container_of(dwork, struct wl1271_stats, sample_work);
+	wl = container_of(stats, struct wl1271, stats);
+
+	mutex_lock(&wl->mutex);
+
+	if (!test_bit(WL1271_FLAG_IN_ELP, &wl->flags))
+		wl1271_debugfs_sample_stats(wl);
+
+	wl1271_debugfs_sample_start(wl);
+
+	mutex_unlock(&wl->mutex);
+}
+
 void wl1271_debugfs_update_stats(struct wl1271 *wl)
 {
+	unsigned int interval = wl->stats.sample_interval;
 	int ret;
 
+	/* the background sampler keeps the snapshot fresh enough */
+	if (interval && wl->stats.fw_stats_prev &&
+	    time_before(jiffies, wl->stats.fw_stats_update +
+			msecs_to_jiffies(WL1271_DEBUGFS_SAMPLE_STALE *
+					 interval)))
+		return;
+
 	mutex_lock(&wl->mutex);
 
 	ret = wl1271_ps_elp_wakeup(wl);
@@ -94,6 +183,269 @@ DEBUGFS_READONLY_FILE(retry_count, "%u", wl->stats.retry_count);
 DEBUGFS_READONLY_FILE(excessive_retries, "%u",
 		      wl->stats.excessive_retries);
 
+static ssize_t mem_adapt_read(struct file *file, char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	struct wlcore_mem_adapt *ma = &wl->mem_adapt;
+	int res = 0;
+	char buf[256];
+
+	mutex_lock(&wl->mutex);
+
+#define MEM_ADAPT_STR(x, fmt, val)   \
+	(res += scnprintf(buf + res, sizeof(buf) - res,\
+			  #x " = " fmt "\n", val))
+
+	MEM_ADAPT_STR(tx_blocks_reserved, "%u", ma->tx_blocks_reserved);
+	MEM_ADAPT_STR(stall_ms_total, "%u", ma->stall_ms_total);
+	MEM_ADAPT_STR(stall_ms_last, "%u", ma->stall_ms_last);
+	MEM_ADAPT_STR(stall_ms_released, "%u", ma->stall_ms_released);
+	MEM_ADAPT_STR(stall_ms_recovered, "%u",
+		      ma->stall_ms_released > ma->stall_ms_last ?
+		      ma->stall_ms_released - ma->stall_ms_last : 0);
+
+#undef MEM_ADAPT_STR
+
+	mutex_unlock(&wl->mutex);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
+static const struct file_operations mem_adapt_ops = {
+	.read = mem_adapt_read,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
+static ssize_t ba_mgr_read(struct file *file, char __user *user_buf,
+			   size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	struct wl1271_link *lnk;
+	const int buf_size = 4096;
+	int ret, res = 0;
+	int hlid, tid;
+	char *buf;
+
+	buf = kzalloc(buf_size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&wl->mutex);
+
+	res += scnprintf(buf + res, buf_size - res,
+			 "sessions = %d\ngranted = %u\nrefused = %u\n"
+			 "evicted_idle = %u\nevicted_busy = %u\n"
+			 "reserve_periods = %u\n",
+			 wl->ba_rx_session_count, wl->ba_mgr.granted,
+			 wl->ba_mgr.refused, wl->ba_mgr.evicted_idle,
+			 wl->ba_mgr.evicted_busy, wl->ba_mgr.reserve_periods);
+
+	/* load is in bytes per second, start_load when the session began */
+	for (hlid = 0; hlid < WL12XX_MAX_LINKS; hlid++) {
+		lnk = &wl->links[hlid];
+
+		for (tid = 0; tid < WLCORE_NUM_TIDS; tid++) {
+			if (!lnk->rx_ba.load[tid] &&
+			    !(lnk->rx_ba.wanted & BIT(tid)))
+				continue;
+
+			res += scnprintf(buf + res, buf_size - res,
+					 "hlid %d tid %d: load %u start_load %u "
+					 "idle %u wanted %d\n",
+					 hlid, tid, lnk->rx_ba.load[tid],
+					 lnk->rx_ba.start_load[tid],
+					 lnk->rx_ba.idle[tid],
+					 !!(lnk->rx_ba.wanted & BIT(tid)));
+		}
+	}
+
+	mutex_unlock(&wl->mutex);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, res);
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations ba_mgr_ops = {
+	.read = ba_mgr_read,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
+static const char * const rx_filter_action_str[] = {
+	[WLCORE_RX_FILTER_RULE_DROP] = "drop",
+	[WLCORE_RX_FILTER_RULE_PASS] = "pass",
+	[WLCORE_RX_FILTER_RULE_COUNT] = "count",
+};
+
+static ssize_t rx_filters_read(struct file *file, char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	struct wlcore_rx_filter_rule *rule;
+	const int buf_size = 1024;
+	int ret, res = 0;
+	int i, j;
+	char *buf;
+
+	buf = kzalloc(buf_size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	wl1271_debugfs_update_stats(wl);
+
+	mutex_lock(&wl->mutex);
+
+	/* FW drops are the sum over all slots, there's no per-slot counter */
+	res += scnprintf(buf + res, buf_size - res,
+			 "active = %d\nfw_drops = %u\n",
+			 wl->rx_filters_active,
+			 wlcore_hw_get_rx_filter_drops(wl));
+
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++) {
+		rule = &wl->rx_filter_rules[i];
+		if (!rule->in_use)
+			continue;
+
+		res += scnprintf(buf + res, buf_size - res,
+				 "%d: %s in_fw %d host_hits %u ", i,
+				 rx_filter_action_str[rule->action],
+				 rule->in_fw, rule->host_hits);
+
+		for (j = 0; j < rule->len; j++) {
+			if (rule->mask[j / 8] & BIT(j % 8))
+				res += scnprintf(buf + res, buf_size - res,
+						 "%02x", rule->pattern[j]);
+			else
+				res += scnprintf(buf + res, buf_size - res,
+						 "xx");
+		}
+
+		res += scnprintf(buf + res, buf_size - res, "\n");
+	}
+
+	mutex_unlock(&wl->mutex);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, res);
+	kfree(buf);
+	return ret;
+}
+
+/*
+ * "<slot> drop|pass|count <pattern>" installs a rule, "<slot> del" removes
+ * it. The pattern is the start of the 802.3 frame in hex, with "xx" for
+ * bytes that don't matter, e.g. "0 drop 01005e0000fb" drops mDNS.
+ */
+static ssize_t rx_filters_write(struct file *file,
+				const char __user *user_buf,
+				size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	struct wlcore_rx_filter_rule rule;
+	char pattern[2 * WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE + 2];
+	char action[8];
+	char buf[128];
+	unsigned int slot;
+	size_t len;
+	int hi, lo;
+	int i, n, ret;
+	int bytes = 0;
+
+	len = min(count, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	memset(&rule, 0, sizeof(rule));
+
+	n = sscanf(buf, "%u %7s %87s", &slot, action, pattern);
+	if (n < 2 || slot >= WL1271_MAX_RX_DATA_FILTERS) {
+		wl1271_warning("illegal value in rx_filters");
+		return -EINVAL;
+	}
+
+	if (!strcmp(action, "del")) {
+		if (n != 2)
+			return -EINVAL;
+		goto set;
+	}
+
+	if (n != 3)
+		return -EINVAL;
+
+	if (!strcmp(action, "drop"))
+		rule.action = WLCORE_RX_FILTER_RULE_DROP;
+	else if (!strcmp(action, "pass"))
+		rule.action = WLCORE_RX_FILTER_RULE_PASS;
+	else if (!strcmp(action, "count"))
+		rule.action = WLCORE_RX_FILTER_RULE_COUNT;
+	else
+		return -EINVAL;
+
+	len = strlen(pattern);
+	if (len % 2 || len / 2 > WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE) {
+		wl1271_warning("illegal pattern in rx_filters");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < len / 2; i++) {
+		if (tolower(pattern[2 * i]) == 'x' &&
+		    tolower(pattern[2 * i + 1]) == 'x')
+			continue;
+
+		hi = hex_to_bin(pattern[2 * i]);
+		lo = hex_to_bin(pattern[2 * i + 1]);
+		if (hi < 0 || lo < 0) {
+			wl1271_warning("illegal pattern in rx_filters");
+			return -EINVAL;
+		}
+
+		rule.pattern[i] = (hi << 4) | lo;
+		rule.mask[i / 8] |= BIT(i % 8);
+		bytes++;
+	}
+
+	/* a rule without a single significant byte would match everything */
+	if (!bytes) {
+		wl1271_warning("rx_filters pattern matches every frame");
+		return -EINVAL;
+	}
+
+	rule.len = len / 2;
+	rule.in_use = true;
+
+set:
+	mutex_lock(&wl->mutex);
+
+	wl->rx_filter_rules[slot] = rule;
+
+	if (wl->state == WL1271_STATE_OFF)
+		goto out;
+
+	ret = wl1271_ps_elp_wakeup(wl);
+	if (ret < 0)
+		goto out;
+
+	ret = wlcore_rx_filters_apply(wl);
+	if (ret < 0)
+		wl1271_warning("applying rx filters failed: %d", ret);
+
+	wl1271_ps_elp_sleep(wl);
+
+out:
+	mutex_unlock(&wl->mutex);
+	return count;
+}
+
+static const struct file_operations rx_filters_ops = {
+	.read = rx_filters_read,
+	.write = rx_filters_write,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
 static ssize_t tx_queue_len_read(struct file *file, char __user *userbuf,
 				 size_t count, loff_t *ppos)
 {
@@ -1003,6 +1355,121 @@ static const struct file_operations tx_stuck_ops = {
 	.llseek = default_llseek,
 };
 
+static ssize_t fw_stats_sample_interval_read(struct file *file,
+					     char __user *user_buf,
+					     size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+
+	return wl1271_format_buffer(user_buf, count, ppos, "%u\n",
+				    wl->stats.sample_interval);
+}
+
+static ssize_t fw_stats_sample_interval_write(struct file *file,
+					      const char __user *user_buf,
+					      size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	unsigned long value;
+	int ret;
+
+	ret = kstrtoul_from_user(user_buf, count, 10, &value);
+	if (ret < 0) {
+		wl1271_warning("illegal value in fw_stats_sample_interval");
+		return -EINVAL;
+	}
+
+	if (value > UINT_MAX) {
+		wl1271_warning("fw_stats_sample_interval is too big");
+		return -ERANGE;
+	}
+
+	mutex_lock(&wl->mutex);
+
+	wl->stats.sample_interval = value;
+	if (value)
+		wl1271_debugfs_sample_start(wl);
+	else
+		cancel_delayed_work(&wl->stats.sample_work);
+
+	mutex_unlock(&wl->mutex);
+	return count;
+}
+
+static const struct file_operations fw_stats_sample_interval_ops = {
+	.read = fw_stats_sample_interval_read,
+	.write = fw_stats_sample_interval_write,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
+/*
+ * Binary dump of the sampled firmware statistics: a header, the latest
+ * raw snapshot and, for every 32-bit word of the snapshot, its change per
+ * second since the previous sample (0 until two samples were taken).
+ */
+struct wl1271_fw_stats_blob_hdr {
+	u32 len;		/* length of the raw snapshot */
+	u32 age;		/* ms since the latest sample */
+	u32 period;		/* ms between the two last samples */
+	u32 sample_interval;	/* configured sampling interval, ms */
+} __packed;
+
+static ssize_t fw_stats_blob_read(struct file *file, char __user *user_buf,
+				  size_t count, loff_t *ppos)
+{
+	struct wl1271 *wl = file->private_data;
+	struct wl1271_fw_stats_blob_hdr *hdr;
+	size_t len = wl->stats.fw_stats_len;
+	size_t words = len / sizeof(u32);
+	u32 *cur, *prev, *rate;
+	unsigned long period;
+	ssize_t ret;
+	size_t i;
+	u8 *buf;
+
+	buf = kzalloc(sizeof(*hdr) + len + words * sizeof(u32), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	hdr = (struct wl1271_fw_stats_blob_hdr *)buf;
+	rate = (u32 *)(buf + sizeof(*hdr) + len);
+
+	/* fall back to the on-demand refresh when sampling is off */
+	wl1271_debugfs_update_stats(wl);
+
+	mutex_lock(&wl->mutex);
+
+	cur = wl->stats.fw_stats;
+	prev = wl->stats.fw_stats_prev;
+	memcpy(buf + sizeof(*hdr), cur, len);
+
+	period = wl->stats.fw_stats_update - wl->stats.fw_stats_prev_update;
+	hdr->len = len;
+	hdr->age = jiffies_to_msecs(jiffies - wl->stats.fw_stats_update);
+	hdr->period = jiffies_to_msecs(period);
+	hdr->sample_interval = wl->stats.sample_interval;
+
+	if (prev && wl->stats.fw_stats_prev_update && hdr->period) {
+		for (i = 0; i < words; i++)
+			rate[i] = div_u64((u64)(u32)(cur[i] - prev[i]) * 1000,
+					  hdr->period);
+	}
+
+	mutex_unlock(&wl->mutex);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf,
+				      sizeof(*hdr) + len + words * sizeof(u32));
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations fw_stats_blob_ops = {
+	.read = fw_stats_blob_read,
+	.open = wl1271_open_file_generic,
+	.llseek = default_llseek,
+};
+
 static int wl1271_debugfs_add_files(struct wl1271 *wl,
 				    struct dentry *rootdir)
 {
@@ -1010,6 +1477,9 @@ static int wl1271_debugfs_add_files(struct wl1271 *wl,
 	struct dentry *entry, *streaming;
 
 	DEBUGFS_ADD(tx_queue_len, rootdir);
+	DEBUGFS_ADD(mem_adapt, rootdir);
+	DEBUGFS_ADD(ba_mgr, rootdir);
+	DEBUGFS_ADD(rx_filters, rootdir);
 	DEBUGFS_ADD(retry_count, rootdir);
 	DEBUGFS_ADD(excessive_retries, rootdir);
 
@@ -1027,6 +1497,8 @@ static int wl1271_debugfs_add_files(struct wl1271 *wl,
 	DEBUGFS_ADD(split_scan_timeout, rootdir);
 	DEBUGFS_ADD(tx_stuck, rootdir);
 	DEBUGFS_ADD(tx_ba_win_size, rootdir);
+	DEBUGFS_ADD(fw_stats_sample_interval, rootdir);
+	DEBUGFS_ADD(fw_stats_blob, rootdir);
 
 	streaming = debugfs_create_dir("rx_streaming", rootdir);
 	if (!streaming || IS_ERR(streaming))
@@ -1053,6 +1525,9 @@ void wl1271_debugfs_reset(struct wl1271 *wl)
 		return;
 
 	memset(wl->stats.fw_stats, 0, wl->stats.fw_stats_len);
+	if (wl->stats.fw_stats_prev)
+		memset(wl->stats.fw_stats_prev, 0, wl->stats.fw_stats_len);
+	wl->stats.fw_stats_prev_update = 0;
 	wl->stats.retry_count = 0;
 	wl->stats.excessive_retries = 0;
 }
@@ -1070,14 +1545,12 @@ int wl1271_debugfs_init(struct wl1271 *wl)
 		goto out;
 	}
 
-	wl->stats.fw_stats = kzalloc(wl->stats.fw_stats_len, GFP_KERNEL);
-	if (!wl->stats.fw_stats) {
+	wl->stats.fw_stats_prev = kzalloc(wl->stats.fw_stats_len, GFP_KERNEL);
+	if (!wl->stats.fw_stats_prev) {
 		ret = -ENOMEM;
 		goto out_remove;
 	}
 
-	wl->stats.fw_stats_update = jiffies;
-
 	ret = wl1271_debugfs_add_files(wl, rootdir);
 	if (ret < 0)
 		goto out_exit;
@@ -1100,6 +1573,6 @@ out:
 
 void wl1271_debugfs_exit(struct wl1271 *wl)
 {
-	kfree(wl->stats.fw_stats);
-	wl->stats.fw_stats = NULL;
+	kfree(wl->stats.fw_stats_prev);
+	wl->stats.fw_stats_prev = NULL;
 }
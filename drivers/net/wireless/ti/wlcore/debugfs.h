@@ -34,6 +34,8 @@ int wl1271_debugfs_init(struct wl1271 *wl);
 void wl1271_debugfs_exit(struct wl1271 *wl);
 void wl1271_debugfs_reset(struct wl1271 *wl);
 void wl1271_debugfs_update_stats(struct wl1271 *wl);
+void wl1271_debugfs_sample_start(struct wl1271 *wl);
+void wl1271_debugfs_sample_work(struct work_struct *work);
 
 #define DEBUGFS_FORMAT_BUFFER_SIZE 256
 
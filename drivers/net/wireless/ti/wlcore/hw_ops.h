@@ -176,6 +176,24 @@ wlcore_hw_get_spare_blocks(struct wl1271 *wl, bool is_gem)
 	return wl->ops->get_spare_blocks(wl, is_gem);
 }
 
+static inline u32
+wlcore_hw_get_rx_mem_overflows(struct wl1271 *wl)
+{
+	if (!wl->ops->get_rx_mem_overflows)
+		return 0;
+
+	return wl->ops->get_rx_mem_overflows(wl);
+}
+
+static inline u32
+wlcore_hw_get_rx_filter_drops(struct wl1271 *wl)
+{
+	if (!wl->ops->get_rx_filter_drops)
+		return 0;
+
+	return wl->ops->get_rx_filter_drops(wl);
+}
+
 static inline int
 wlcore_hw_set_key(struct wl1271 *wl, enum set_key_cmd cmd,
 		  struct ieee80211_vif *vif,
@@ -57,6 +57,7 @@
 #define WL1271_BOOT_RETRIES 20
 
 static char *fwlog_param;
+static bool fwlog_tstamp;
 static bool bug_on_recovery;
 static bool no_recovery;
 static char *plt_fw_name;
@@ -432,6 +433,15 @@ static void wl12xx_fw_status(struct wl1271 *wl,
 		wl->tx_pkts_freed[i] = status_2->counters.tx_released_pkts[i];
 	}
 
+	/* the FW reports the last TX rate of a single link at a time */
+	if (status_2->counters.tx_last_rate_mbps &&
+	    status_2->counters.hlid < WL12XX_MAX_LINKS) {
+		struct wl1271_link *lnk = &wl->links[status_2->counters.hlid];
+
+		lnk->fw_rate_idx = status_2->counters.tx_last_rate;
+		lnk->fw_rate_mbps = status_2->counters.tx_last_rate_mbps;
+	}
+
 	/* prevent wrap-around in total blocks counter */
 	if (likely(wl->tx_blocks_freed <=
 		   le32_to_cpu(status_2->total_released_blks)))
@@ -474,8 +484,10 @@ static void wl12xx_fw_status(struct wl1271 *wl,
 				      avail);
 
 	/* if more blocks are available now, tx work can be scheduled */
-	if (wl->tx_blocks_available > old_tx_blk_count)
+	if (wl->tx_blocks_available > old_tx_blk_count) {
 		clear_bit(WL1271_FLAG_FW_TX_BUSY, &wl->flags);
+		wlcore_mem_adapt_stall_end(wl);
+	}
 
 	/* for AP update num of allocated TX blocks per link and ps status */
 	wl12xx_for_each_wlvif_ap(wl, wlvif) {
@@ -587,6 +599,7 @@ static irqreturn_t wl1271_irq(int irq, void *cookie)
 			wl1271_debug(DEBUG_IRQ, "WL1271_ACX_INTR_DATA");
 
 			wl12xx_rx(wl, wl->fw_status_1);
+			wlcore_mem_adapt_rx(wl);
 
 			/* Check if any tx blocks were freed */
 			spin_lock_irqsave(&wl->wl_lock, flags);
@@ -745,9 +758,57 @@ void wl12xx_queue_recovery_work(struct wl1271 *wl)
 		ieee80211_queue_work(wl->hw, &wl->recovery_work);
 }
 
+static inline struct wlcore_fwlog_tail *wlcore_fwlog_tail(struct wl1271 *wl)
+{
+	return (void *)wl->fwlog + WLCORE_FWLOG_TAIL_PGOFF * PAGE_SIZE;
+}
+
+static inline u8 *wlcore_fwlog_data(struct wl1271 *wl)
+{
+	return (u8 *)wl->fwlog + WLCORE_FWLOG_DATA_PGOFF * PAGE_SIZE;
+}
+
+/*
+ * Bytes between the consumer's tail and the driver's head. The consumer
+ * may have left anything in the tail, so treat a tail that is not within
+ * the ring as if it had consumed nothing, i.e. the ring is full.
+ */
+static u32 wlcore_fwlog_used(struct wl1271 *wl, u32 head, u32 *tail)
+{
+	u32 used;
+
+	*tail = ACCESS_ONCE(wlcore_fwlog_tail(wl)->tail);
+	used = head - *tail;
+	if (used > WLCORE_FWLOG_RING_SIZE) {
+		used = WLCORE_FWLOG_RING_SIZE;
+		*tail = head - used;
+	}
+
+	return used;
+}
+
+static void wlcore_fwlog_ring_write(struct wl1271 *wl, u32 head,
+				    const void *src, size_t len)
+{
+	u8 *data = wlcore_fwlog_data(wl);
+	u32 off = head & (WLCORE_FWLOG_RING_SIZE - 1);
+	size_t first = min_t(size_t, len, WLCORE_FWLOG_RING_SIZE - off);
+
+	memcpy(data + off, src, first);
+	memcpy(data, src + first, len - first);
+}
+
+/*
+ * Only called from the RX and recovery paths, which are serialized by
+ * wl->mutex, so there is a single producer. Consumers don't take the
+ * mutex, the head and tail indices are all they share with us.
+ */
 size_t wl12xx_copy_fwlog(struct wl1271 *wl, u8 *memblock, size_t maxlen)
 {
-	size_t len = 0;
+	struct wlcore_fwlog_ring *ring = wl->fwlog;
+	struct wlcore_fwlog_rec rec;
+	size_t len = 0, needed;
+	u32 head, tail, used;
 
 	/* The FW log is a length-value list, find where the log end */
 	while (len < maxlen) {
@@ -758,12 +819,41 @@ size_t wl12xx_copy_fwlog(struct wl1271 *wl, u8 *memblock, size_t maxlen)
 		len += memblock[len] + 1;
 	}
 
-	/* Make sure we have enough room */
-	len = min(len, (size_t)(PAGE_SIZE - wl->fwlog_size));
+	if (!len)
+		return 0;
+
+	needed = len;
+	if (wl->fwlog_flags & WLCORE_FWLOG_RING_TIMESTAMPS)
+		needed += sizeof(rec);
+
+	head = wl->fwlog_head;
+	used = wlcore_fwlog_used(wl, head, &tail);
 
-	/* Fill the FW log file, consumed by the sysfs fwlog entry */
-	memcpy(wl->fwlog + wl->fwlog_size, memblock, len);
-	wl->fwlog_size += len;
+	/* order the tail read before overwriting the space it released */
+	smp_mb();
+
+	if (WLCORE_FWLOG_RING_SIZE - used < needed) {
+		wl->fwlog_dropped_bytes += len;
+		wl->fwlog_dropped_records++;
+		ring->dropped_bytes = wl->fwlog_dropped_bytes;
+		ring->dropped_records = wl->fwlog_dropped_records;
+		return 0;
+	}
+
+	if (wl->fwlog_flags & WLCORE_FWLOG_RING_TIMESTAMPS) {
+		rec.len = len;
+		rec.reserved = 0;
+		rec.timestamp = local_clock();
+		wlcore_fwlog_ring_write(wl, head, &rec, sizeof(rec));
+		head += sizeof(rec);
+	}
+
+	wlcore_fwlog_ring_write(wl, head, memblock, len);
+
+	/* publish the data before the new head */
+	smp_wmb();
+	wl->fwlog_head = head + len;
+	ACCESS_ONCE(ring->head) = wl->fwlog_head;
 
 	return len;
 }
@@ -1228,7 +1318,6 @@ static struct notifier_block wl1271_dev_notifier = {
 	.notifier_call = wl1271_dev_notify,
 };
 
-#ifdef CONFIG_PM
 int wl1271_validate_wowlan_pattern(struct cfg80211_wowlan_trig_pkt_pattern *p)
 {
 	if (p->pattern_len > WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE) {
@@ -1266,7 +1355,7 @@ int wl1271_build_rx_filter_field(struct wl12xx_rx_data_filter_field *field,
 	mask = field->pattern + len;
 
 	for (i = offset; i < (offset+len); i++) {
-		if (test_bit(i, (unsigned long *)bitmask))
+		if (bitmask[i / 8] & BIT(i % 8))
 			*mask = 0xFF;
 
 		mask++;
@@ -1343,6 +1432,7 @@ err:
 	return ret;
 }
 
+#ifdef CONFIG_PM
 static int wl1271_configure_wowlan(struct wl1271 *wl,
 				   struct cfg80211_wowlan *wow)
 {
@@ -1572,6 +1662,13 @@ static int wl1271_op_resume(struct ieee80211_hw *hw)
 		wl1271_configure_resume(wl, wlvif);
 	}
 	wl->wow_enabled = false;
+
+	/* take the FW data filters back from WoWLAN */
+	if (wl->state == WL1271_STATE_ON &&
+	    wl1271_ps_elp_wakeup(wl) == 0) {
+		wlcore_rx_filters_apply(wl);
+		wl1271_ps_elp_sleep(wl);
+	}
 	mutex_unlock(&wl->mutex);
 
 	return 0;
@@ -1639,6 +1736,10 @@ static void wl1271_op_stop(struct ieee80211_hw *hw)
 	cancel_work_sync(&wl->netstack_work);
 	cancel_work_sync(&wl->tx_work);
 	cancel_delayed_work_sync(&wl->elp_work);
+	cancel_delayed_work_sync(&wl->mem_adapt.work);
+	cancel_delayed_work_sync(&wl->ba_mgr.work);
+	cancel_delayed_work_sync(&wl->stats.sample_work);
+	wl->ba_mgr.reserve_periods = 0;
 
 	/* let's notify MAC80211 about the remaining pending TX frames */
 	wl12xx_tx_reset(wl);
@@ -1666,6 +1767,13 @@ static void wl1271_op_stop(struct ieee80211_hw *hw)
 	memset(wl->roc_map, 0, sizeof(wl->roc_map));
 	wl->active_sta_count = 0;
 
+	/* the runtime RX filter rules are kept and reprogrammed on assoc */
+	memset(wl->rx_data_filters_status, 0,
+	       sizeof(wl->rx_data_filters_status));
+	wl->rx_filters_active = false;
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++)
+		wl->rx_filter_rules[i].in_fw = false;
+
 	/* The system link is always allocated */
 	__set_bit(WL12XX_SYSTEM_HLID, wl->links_map);
 
@@ -1683,6 +1791,13 @@ static void wl1271_op_stop(struct ieee80211_hw *hw)
 		wl->tx_allocated_pkts[i] = 0;
 	}
 
+	/* start over without holding back TX blocks */
+	wl->mem_adapt.tx_blocks_reserved = 0;
+	wl->mem_adapt.stalled = false;
+	wl->mem_adapt.stall_ms = 0;
+	wl->mem_adapt.stall_ms_last = 0;
+	wl->mem_adapt.rx_overflows = 0;
+
 	wl1271_debugfs_reset(wl);
 
 	kfree(wl->fw_status_1);
@@ -1893,6 +2008,7 @@ power_off:
 		     wl->enable_11a ? "" : "not ");
 
 	wl->state = WL1271_STATE_ON;
+	wl1271_debugfs_sample_start(wl);
 out:
 	return booted;
 }
@@ -3206,35 +3322,46 @@ static int wl1271_ssid_set(struct ieee80211_vif *vif, struct sk_buff *skb,
 	return 0;
 }
 
-static void wl12xx_remove_ie(struct sk_buff *skb, u8 eid, int ieoffset)
+static bool wl12xx_is_p2p_ie(const u8 *ie)
 {
-	int len;
-	const u8 *next, *end = skb->data + skb->len;
-	u8 *ie = (u8 *)cfg80211_find_ie(eid, skb->data + ieoffset,
-					skb->len - ieoffset);
-	if (!ie)
-		return;
-	len = ie[1] + 2;
-	next = ie + len;
-	memmove(ie, next, end - next);
-	skb_trim(skb, skb->len - len);
+	return ie[0] == WLAN_EID_VENDOR_SPECIFIC && ie[1] >= 4 &&
+	       ie[2] == ((WLAN_OUI_WFA >> 16) & 0xff) &&
+	       ie[3] == ((WLAN_OUI_WFA >> 8) & 0xff) &&
+	       ie[4] == (WLAN_OUI_WFA & 0xff) &&
+	       ie[5] == WLAN_OUI_TYPE_WFA_P2P;
 }
 
-static void wl12xx_remove_vendor_ie(struct sk_buff *skb,
-					    unsigned int oui, u8 oui_type,
-					    int ieoffset)
+/*
+ * Turn a beacon into a probe response template in a single pass over
+ * its IEs, compacting the kept ones in place:
+ * - the TIM ie only belongs in beacons.
+ * - the fw reponds to probe requests that don't include the p2p ie.
+ *   probe requests with p2p ie will be passed, and will be responded
+ *   by the supplicant (the spec forbids including the p2p ie when
+ *   responding to probe requests that didn't include it).
+ */
+static void wl12xx_strip_probe_resp_ies(struct sk_buff *skb, int ieoffset)
 {
+	u8 *pos = skb->data + ieoffset;
+	u8 *out = pos;
+	const u8 *end = skb->data + skb->len;
 	int len;
-	const u8 *next, *end = skb->data + skb->len;
-	u8 *ie = (u8 *)cfg80211_find_vendor_ie(oui, oui_type,
-					       skb->data + ieoffset,
-					       skb->len - ieoffset);
-	if (!ie)
-		return;
-	len = ie[1] + 2;
-	next = ie + len;
-	memmove(ie, next, end - next);
-	skb_trim(skb, skb->len - len);
+
+	while (end - pos >= 2 && end - pos >= pos[1] + 2) {
+		len = pos[1] + 2;
+
+		if (pos[0] != WLAN_EID_TIM && !wl12xx_is_p2p_ie(pos)) {
+			if (out != pos)
+				memmove(out, pos, len);
+			out += len;
+		}
+		pos += len;
+	}
+
+	/* keep a truncated trailing ie, if any, as it was */
+	if (out != pos)
+		memmove(out, pos, end - pos);
+	skb_trim(skb, skb->len - (pos - out));
 }
 
 static int wl1271_ap_set_probe_resp_tmpl(struct wl1271 *wl, u32 rates,
@@ -3372,26 +3499,58 @@ static int wlcore_set_beacon_template(struct wl1271 *wl,
 {
 	struct wl12xx_vif *wlvif = wl12xx_vif_to_data(vif);
 	struct ieee80211_hdr *hdr;
-	u32 min_rate;
+	u32 min_rate, crc, gen;
 	int ret;
 	int ieoffset = offsetof(struct ieee80211_mgmt,
 				u.beacon.variable);
-	struct sk_buff *beacon = ieee80211_beacon_get(wl->hw, vif);
+	u16 tim_offset, tim_len;
+	struct sk_buff *beacon;
 	u16 tmpl_id;
+	bool same_rate;
 
+	min_rate = wl1271_tx_min_rate_get(wl, wlvif->basic_rate_set);
+	same_rate = wlvif->beacon_tmpl_valid &&
+		    wlvif->beacon_tmpl_rate == min_rate;
+
+	/* nothing was set in mac80211 since the last upload */
+	gen = ieee80211_beacon_get_gen(vif);
+	if (same_rate && gen && wlvif->beacon_tmpl_gen == gen) {
+		wl1271_debug(DEBUG_MASTER, "beacon generation unchanged");
+		ret = 0;
+		goto out;
+	}
+
+	beacon = ieee80211_beacon_get_tim(wl->hw, vif, &tim_offset, &tim_len);
 	if (!beacon) {
 		ret = -EINVAL;
 		goto out;
 	}
 
+	/*
+	 * The fw maintains the TIM itself, and mac80211 updates the
+	 * DTIM count on every call, so leave the TIM out of the
+	 * comparison. Skip the (slow) template upload if nothing else
+	 * changed since the last one.
+	 */
+	crc = crc32_le(~0, beacon->data, tim_offset);
+	crc = crc32_le(crc, beacon->data + tim_offset + tim_len,
+		       beacon->len - tim_offset - tim_len);
+	if (same_rate && wlvif->beacon_tmpl_crc == crc) {
+		wl1271_debug(DEBUG_MASTER, "beacon unchanged");
+		wlvif->beacon_tmpl_gen = gen;
+		dev_kfree_skb(beacon);
+		ret = 0;
+		goto out;
+	}
+
 	wl1271_debug(DEBUG_MASTER, "beacon updated");
+	wlvif->beacon_tmpl_valid = false;
 
 	ret = wl1271_ssid_set(vif, beacon, ieoffset);
 	if (ret < 0) {
 		dev_kfree_skb(beacon);
 		goto out;
 	}
-	min_rate = wl1271_tx_min_rate_get(wl, wlvif->basic_rate_set);
 	tmpl_id = is_ap ? CMD_TEMPL_AP_BEACON :
 		CMD_TEMPL_BEACON;
 	ret = wl1271_cmd_template_set(wl, wlvif->role_id, tmpl_id,
@@ -3410,19 +3569,8 @@ static int wlcore_set_beacon_template(struct wl1271 *wl,
 	if (test_bit(WLVIF_FLAG_AP_PROBE_RESP_SET, &wlvif->flags))
 		goto end_bcn;
 
-	/* remove TIM ie from probe response */
-	wl12xx_remove_ie(beacon, WLAN_EID_TIM, ieoffset);
-
-	/*
-	 * remove p2p ie from probe response.
-	 * the fw reponds to probe requests that don't include
-	 * the p2p ie. probe requests with p2p ie will be passed,
-	 * and will be responded by the supplicant (the spec
-	 * forbids including the p2p ie when responding to probe
-	 * requests that didn't include it).
-	 */
-	wl12xx_remove_vendor_ie(beacon, WLAN_OUI_WFA,
-				WLAN_OUI_TYPE_WFA_P2P, ieoffset);
+	/* remove TIM and p2p ies from probe response */
+	wl12xx_strip_probe_resp_ies(beacon, ieoffset);
 
 	hdr = (struct ieee80211_hdr *) beacon->data;
 	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_MGMT |
@@ -3443,6 +3591,10 @@ end_bcn:
 	if (ret < 0)
 		goto out;
 
+	wlvif->beacon_tmpl_gen = gen;
+	wlvif->beacon_tmpl_crc = crc;
+	wlvif->beacon_tmpl_rate = min_rate;
+	wlvif->beacon_tmpl_valid = true;
 out:
 	return ret;
 }
@@ -3548,6 +3700,7 @@ static void wl1271_bss_info_changed_ap(struct wl1271 *wl,
 				clear_bit(WLVIF_FLAG_AP_STARTED, &wlvif->flags);
 				clear_bit(WLVIF_FLAG_AP_PROBE_RESP_SET,
 					  &wlvif->flags);
+				wlvif->beacon_tmpl_valid = false;
 				wl1271_debug(DEBUG_AP, "stopped AP");
 			}
 		}
@@ -3946,6 +4099,9 @@ static void wl1271_op_bss_info_changed(struct ieee80211_hw *hw,
 	else
 		wl1271_bss_info_changed_sta(wl, vif, bss_conf, changed);
 
+	if (!is_ap && (changed & BSS_CHANGED_ASSOC))
+		wlcore_rx_filters_apply(wl);
+
 	wl1271_ps_elp_sleep(wl);
 
 out:
@@ -4229,6 +4385,157 @@ out:
 	mutex_unlock(&wl->mutex);
 }
 
+/* ms */
+#define WLCORE_BA_MGR_PERIOD		1000
+/* RX BA sessions without traffic for this many periods are torn down */
+#define WLCORE_BA_MGR_IDLE_PERIODS	10
+/* periods a session evicted for a refused flow is kept for that flow */
+#define WLCORE_BA_MGR_RESERVE_PERIODS	3
+
+static void wlcore_ba_mgr_arm(struct wl1271 *wl)
+{
+	if (!delayed_work_pending(&wl->ba_mgr.work))
+		ieee80211_queue_delayed_work(wl->hw, &wl->ba_mgr.work,
+				msecs_to_jiffies(WLCORE_BA_MGR_PERIOD));
+}
+
+/* called for every QoS data frame received, with wl->mutex held */
+void wlcore_ba_mgr_rx(struct wl1271 *wl, u8 hlid, u8 tid, u32 len)
+{
+	wl->links[hlid].rx_ba.bytes[tid] += len;
+	wlcore_ba_mgr_arm(wl);
+}
+
+static u8 *wlcore_ba_mgr_rx_bitmap(struct wl1271 *wl,
+				   struct wl12xx_vif *wlvif, u8 hlid)
+{
+	if (wlvif->bss_type == BSS_TYPE_STA_BSS && hlid == wlvif->sta.hlid)
+		return &wlvif->sta.ba_rx_bitmap;
+
+	if (wlvif->bss_type == BSS_TYPE_AP_BSS &&
+	    test_bit(hlid, wlvif->ap.sta_hlid_map))
+		return &wl->links[hlid].ba_bitmap;
+
+	return NULL;
+}
+
+static void wlcore_ba_mgr_stop(struct wl1271 *wl, struct wl12xx_vif *wlvif,
+			       u8 hlid, u8 tids)
+{
+	struct ieee80211_vif *vif = wl12xx_wlvif_to_vif(wlvif);
+	const u8 *addr;
+
+	if (wlvif->bss_type == BSS_TYPE_STA_BSS)
+		addr = vif->bss_conf.bssid;
+	else
+		addr = wl->links[hlid].addr;
+
+	wl1271_debug(DEBUG_MAC80211, "ba mgr: stop rx ba hlid %d tids 0x%x",
+		     hlid, tids);
+
+	/* the session is torn down by mac80211 through ampdu_action */
+	ieee80211_stop_rx_ba_session(vif, tids, addr);
+}
+
+/*
+ * Update the per-TID load of every link, tear down idle RX BA sessions
+ * and, when all the FW sessions are taken, free the lightest one if a
+ * much heavier flow had its ADDBA refused.
+ */
+static void wlcore_ba_mgr_work(struct work_struct *work)
+{
+	struct delayed_work *dwork;
+	struct wl1271 *wl;
+	struct wl12xx_vif *wlvif, *lightest_wlvif = NULL;
+	u32 lightest_load = 0, wanted_load = 0;
+	u8 lightest_hlid = 0, lightest_tid = 0;
+	bool traffic = false, freed = false;
+	int hlid, tid;
+
+	dwork = container_of(work, struct delayed_work, work);
+	wl = container_of(dwork, struct wl1271, ba_mgr.work);
+
+	mutex_lock(&wl->mutex);
+
+	if (unlikely(wl->state == WL1271_STATE_OFF))
+		goto out;
+
+	if (wl->ba_mgr.reserve_periods)
+		wl->ba_mgr.reserve_periods--;
+
+	wl12xx_for_each_wlvif(wl, wlvif) {
+		if (!wlvif->ba_support)
+			continue;
+
+		for_each_set_bit(hlid, wlvif->links_map, WL12XX_MAX_LINKS) {
+			struct wl1271_link *lnk = &wl->links[hlid];
+			u8 *ba_bitmap, idle = 0;
+
+			ba_bitmap = wlcore_ba_mgr_rx_bitmap(wl, wlvif, hlid);
+			if (!ba_bitmap)
+				continue;
+
+			for (tid = 0; tid < WLCORE_NUM_TIDS; tid++) {
+				u32 bytes = lnk->rx_ba.bytes[tid];
+				u32 load;
+
+				lnk->rx_ba.bytes[tid] = 0;
+				load = (lnk->rx_ba.load[tid] * 3 + bytes) / 4;
+				lnk->rx_ba.load[tid] = load;
+
+				if (bytes) {
+					lnk->rx_ba.idle[tid] = 0;
+					traffic = true;
+				} else if (lnk->rx_ba.idle[tid] < 0xff) {
+					lnk->rx_ba.idle[tid]++;
+				}
+
+				if (!(*ba_bitmap & BIT(tid))) {
+					if (lnk->rx_ba.wanted & BIT(tid))
+						wanted_load = max(wanted_load,
+								  load);
+					continue;
+				}
+
+				if (lnk->rx_ba.idle[tid] >=
+				    WLCORE_BA_MGR_IDLE_PERIODS) {
+					idle |= BIT(tid);
+				} else if (!lightest_wlvif ||
+					   load < lightest_load) {
+					lightest_wlvif = wlvif;
+					lightest_hlid = hlid;
+					lightest_tid = tid;
+					lightest_load = load;
+				}
+			}
+
+			if (idle) {
+				wlcore_ba_mgr_stop(wl, wlvif, hlid, idle);
+				wl->ba_mgr.evicted_idle += hweight8(idle);
+				freed = true;
+			}
+		}
+	}
+
+	if (!freed && lightest_wlvif &&
+	    wl->ba_rx_session_count >= RX_BA_MAX_SESSIONS &&
+	    wanted_load > 2 * lightest_load) {
+		wlcore_ba_mgr_stop(wl, lightest_wlvif, lightest_hlid,
+				   BIT(lightest_tid));
+		wl->ba_mgr.evicted_busy++;
+
+		/* don't let the evicted flow take the session right back */
+		wl->ba_mgr.reserve_periods = WLCORE_BA_MGR_RESERVE_PERIODS;
+	}
+
+	/* keep running while there is traffic or sessions to watch */
+	if (traffic || wl->ba_rx_session_count || wl->ba_mgr.reserve_periods)
+		wlcore_ba_mgr_arm(wl);
+
+out:
+	mutex_unlock(&wl->mutex);
+}
+
 static int wl1271_op_ampdu_action(struct ieee80211_hw *hw,
 				  struct ieee80211_vif *vif,
 				  enum ieee80211_ampdu_mlme_action action,
@@ -4283,8 +4590,24 @@ static int wl1271_op_ampdu_action(struct ieee80211_hw *hw,
 		}
 
 		if (wl->ba_rx_session_count >= RX_BA_MAX_SESSIONS) {
+			/* the BA manager may free a session for this flow */
+			wl->links[hlid].rx_ba.wanted |= BIT(tid);
+			wl->ba_mgr.refused++;
+			ret = -EBUSY;
+			wl1271_debug(DEBUG_MAC80211,
+				     "exceeded max RX BA sessions, hlid %d tid %d",
+				     hlid, tid);
+			break;
+		}
+
+		/* a session freed for the refused flows is kept for them */
+		if (wl->ba_mgr.reserve_periods &&
+		    !(wl->links[hlid].rx_ba.wanted & BIT(tid))) {
+			wl->ba_mgr.refused++;
 			ret = -EBUSY;
-			wl1271_error("exceeded max RX BA sessions");
+			wl1271_debug(DEBUG_MAC80211,
+				     "RX BA session reserved, hlid %d tid %d",
+				     hlid, tid);
 			break;
 		}
 
@@ -4298,8 +4621,18 @@ static int wl1271_op_ampdu_action(struct ieee80211_hw *hw,
 		ret = wl12xx_acx_set_ba_receiver_session(wl, tid, *ssn, true,
 							 hlid);
 		if (!ret) {
+			struct wl1271_link *lnk = &wl->links[hlid];
+
 			*ba_bitmap |= BIT(tid);
 			wl->ba_rx_session_count++;
+
+			if (lnk->rx_ba.wanted & BIT(tid))
+				wl->ba_mgr.reserve_periods = 0;
+			lnk->rx_ba.wanted &= ~BIT(tid);
+			lnk->rx_ba.start_load[tid] = lnk->rx_ba.load[tid];
+			lnk->rx_ba.idle[tid] = 0;
+			wl->ba_mgr.granted++;
+			wlcore_ba_mgr_arm(wl);
 		}
 		break;
 
@@ -4729,61 +5062,79 @@ static ssize_t wl1271_sysfs_read_fwlog(struct file *filp, struct kobject *kobj,
 {
 	struct device *dev = container_of(kobj, struct device, kobj);
 	struct wl1271 *wl = dev_get_drvdata(dev);
+	u8 *data = wlcore_fwlog_data(wl);
+	u32 head, tail, off;
 	ssize_t len;
+	size_t first;
 	int ret;
 
-	ret = mutex_lock_interruptible(&wl->mutex);
+	/* Let only one thread read the log at a time, blocking others */
+	ret = mutex_lock_interruptible(&wl->fwlog_mutex);
 	if (ret < 0)
 		return -ERESTARTSYS;
 
-	/* Let only one thread read the log at a time, blocking others */
-	while (wl->fwlog_size == 0) {
-		DEFINE_WAIT(wait);
-
-		prepare_to_wait_exclusive(&wl->fwlog_waitq,
-					  &wait,
-					  TASK_INTERRUPTIBLE);
+	do {
+		ret = wait_event_interruptible(wl->fwlog_waitq,
+				wl->fwlog_closed ||
+				ACCESS_ONCE(wl->fwlog_head) !=
+				ACCESS_ONCE(wlcore_fwlog_tail(wl)->tail));
+		if (ret < 0) {
+			len = -ERESTARTSYS;
+			goto out;
+		}
 
-		if (wl->fwlog_size != 0) {
-			finish_wait(&wl->fwlog_waitq, &wait);
-			break;
+		/* Check if the fwlog is still valid */
+		if (wl->fwlog_closed) {
+			len = 0;
+			goto out;
 		}
 
-		mutex_unlock(&wl->mutex);
+		head = ACCESS_ONCE(wl->fwlog_head);
+	} while (!wlcore_fwlog_used(wl, head, &tail));
 
-		schedule();
-		finish_wait(&wl->fwlog_waitq, &wait);
+	/* read the data only after seeing the head that published it */
+	smp_rmb();
 
-		if (signal_pending(current))
-			return -ERESTARTSYS;
+	/* Seeking is not supported - old logs are not kept. Disregard pos. */
+	len = min_t(size_t, count, head - tail);
+	off = tail & (WLCORE_FWLOG_RING_SIZE - 1);
+	first = min_t(size_t, len, WLCORE_FWLOG_RING_SIZE - off);
+	memcpy(buffer, data + off, first);
+	memcpy(buffer + first, data, len - first);
 
-		ret = mutex_lock_interruptible(&wl->mutex);
-		if (ret < 0)
-			return -ERESTARTSYS;
-	}
+	/* finish reading before handing the space back to the producer */
+	smp_mb();
+	ACCESS_ONCE(wlcore_fwlog_tail(wl)->tail) = tail + len;
 
-	/* Check if the fwlog is still valid */
-	if (wl->fwlog_size < 0) {
-		mutex_unlock(&wl->mutex);
-		return 0;
-	}
+out:
+	mutex_unlock(&wl->fwlog_mutex);
 
-	/* Seeking is not supported - old logs are not kept. Disregard pos. */
-	len = min(count, (size_t)wl->fwlog_size);
-	wl->fwlog_size -= len;
-	memcpy(buffer, wl->fwlog, len);
+	return len;
+}
 
-	/* Make room for new messages */
-	memmove(wl->fwlog, wl->fwlog + len, wl->fwlog_size);
+static int wl1271_sysfs_mmap_fwlog(struct file *filp, struct kobject *kobj,
+				   struct bin_attribute *bin_attr,
+				   struct vm_area_struct *vma)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct wl1271 *wl = dev_get_drvdata(dev);
 
-	mutex_unlock(&wl->mutex);
+	/* only the tail page may be written to by the consumer */
+	if (vma->vm_flags & VM_WRITE) {
+		if (vma->vm_pgoff != WLCORE_FWLOG_TAIL_PGOFF ||
+		    vma->vm_end - vma->vm_start != PAGE_SIZE)
+			return -EPERM;
+	} else {
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
 
-	return len;
+	return remap_vmalloc_range(vma, wl->fwlog, vma->vm_pgoff);
 }
 
 static struct bin_attribute fwlog_attr = {
-	.attr = {.name = "fwlog", .mode = S_IRUSR},
+	.attr = {.name = "fwlog", .mode = S_IRUSR | S_IWUSR},
 	.read = wl1271_sysfs_read_fwlog,
+	.mmap = wl1271_sysfs_mmap_fwlog,
 };
 
 static void wl12xx_derive_mac_addresses(struct wl1271 *wl,
@@ -4865,6 +5216,16 @@ static int wl1271_register_hw(struct wl1271 *wl)
 
 	wl12xx_derive_mac_addresses(wl, oui_addr, nic_addr, 2);
 
+	if (!wl->stats.fw_stats) {
+		wl->stats.fw_stats = kzalloc(wl->stats.fw_stats_len,
+					     GFP_KERNEL);
+		if (!wl->stats.fw_stats) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		wl->stats.fw_stats_update = jiffies;
+	}
+
 	ret = ieee80211_register_hw(wl->hw);
 	if (ret < 0) {
 		wl1271_error("unable to register mac80211 hw: %d", ret);
@@ -5040,6 +5401,9 @@ struct ieee80211_hw *wlcore_alloc_hw(size_t priv_size)
 	skb_queue_head_init(&wl->deferred_tx_queue);
 
 	INIT_DELAYED_WORK(&wl->elp_work, wl1271_elp_work);
+	INIT_DELAYED_WORK(&wl->mem_adapt.work, wlcore_mem_adapt_work);
+	INIT_DELAYED_WORK(&wl->ba_mgr.work, wlcore_ba_mgr_work);
+	INIT_DELAYED_WORK(&wl->stats.sample_work, wl1271_debugfs_sample_work);
 	INIT_WORK(&wl->netstack_work, wl1271_netstack_work);
 	INIT_WORK(&wl->tx_work, wl1271_tx_work);
 	INIT_WORK(&wl->recovery_work, wl1271_recovery_work);
@@ -5069,7 +5433,8 @@ struct ieee80211_hw *wlcore_alloc_hw(size_t priv_size)
 	wl->sched_scanning = false;
 	wl->system_hlid = WL12XX_SYSTEM_HLID;
 	wl->active_sta_count = 0;
-	wl->fwlog_size = 0;
+	wl->fwlog_closed = false;
+	mutex_init(&wl->fwlog_mutex);
 	init_waitqueue_head(&wl->fwlog_waitq);
 
 	/* The system link is always allocated */
@@ -5103,15 +5468,28 @@ struct ieee80211_hw *wlcore_alloc_hw(size_t priv_size)
 		goto err_aggr;
 	}
 
-	/* Allocate one page for the FW log */
-	wl->fwlog = (u8 *)get_zeroed_page(GFP_KERNEL);
+	/* Allocate the FW log ring, it is mapped to userspace */
+	wl->fwlog = vmalloc_user(PAGE_SIZE * WLCORE_FWLOG_DATA_PGOFF +
+				 WLCORE_FWLOG_RING_SIZE);
 	if (!wl->fwlog) {
 		ret = -ENOMEM;
 		goto err_dummy_packet;
 	}
 
+	if (fwlog_tstamp)
+		wl->fwlog_flags |= WLCORE_FWLOG_RING_TIMESTAMPS;
+	wl->fwlog->size = WLCORE_FWLOG_RING_SIZE;
+	wl->fwlog->flags = wl->fwlog_flags;
+
+	ret = wlcore_scan_alloc(wl);
+	if (ret < 0)
+		goto err_fwlog;
+
 	return hw;
 
+err_fwlog:
+	vfree(wl->fwlog);
+
 err_dummy_packet:
 	dev_kfree_skb(wl->dummy_packet);
 
@@ -5141,17 +5519,16 @@ int wlcore_free_hw(struct wl1271 *wl)
 	wake_lock_destroy(&wl->rx_wake);
 #endif
 	/* Unblock any fwlog readers */
-	mutex_lock(&wl->mutex);
-	wl->fwlog_size = -1;
+	wl->fwlog_closed = true;
 	wake_up_interruptible_all(&wl->fwlog_waitq);
-	mutex_unlock(&wl->mutex);
 
 	device_remove_bin_file(wl->dev, &fwlog_attr);
 
 	device_remove_file(wl->dev, &dev_attr_hw_pg_ver);
 
 	device_remove_file(wl->dev, &dev_attr_bt_coex_state);
-	free_page((unsigned long)wl->fwlog);
+	wlcore_scan_free(wl);
+	vfree(wl->fwlog);
 	dev_kfree_skb(wl->dummy_packet);
 	free_pages((unsigned long)wl->aggr_buf,
 			get_order(WL1271_AGGR_BUFFER_SIZE));
@@ -5166,6 +5543,7 @@ int wlcore_free_hw(struct wl1271 *wl)
 
 	kfree(wl->fw_status_1);
 	kfree(wl->tx_res_if);
+	kfree(wl->stats.fw_stats);
 	destroy_workqueue(wl->freezable_wq);
 
 	kfree(wl->priv);
@@ -5349,6 +5727,9 @@ module_param_named(fwlog, fwlog_param, charp, 0);
 MODULE_PARM_DESC(keymap,
 		 "FW logger options: continuous, ondemand, dbgpins or disable");
 
+module_param(fwlog_tstamp, bool, S_IRUSR);
+MODULE_PARM_DESC(fwlog_tstamp, "Timestamp every chunk of the FW log");
+
 module_param(bug_on_recovery, bool, S_IRUSR | S_IWUSR);
 MODULE_PARM_DESC(bug_on_recovery, "BUG() on fw recovery");
 
@@ -31,6 +31,7 @@
 #include "tx.h"
 #include "io.h"
 #include "hw_ops.h"
+#include "scan.h"
 
 /*
  * TODO: this is here just for now, it must be removed when the data
@@ -99,6 +100,56 @@ static void wl1271_rx_status(struct wl1271 *wl,
 	}
 }
 
+/*
+ * Account a data frame that reached the host to the first runtime RX
+ * filter rule it matches, walking the slots in the same order as the FW.
+ * The rules are matched against the 802.3 view of the frame, rebuilt from
+ * the 802.11 addresses and the LLC/SNAP ethertype.
+ */
+static void wlcore_rx_filters_count(struct wl1271 *wl, struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	u8 frame[WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE];
+	struct wlcore_rx_filter_rule *rule;
+	unsigned int hdrlen, len;
+	int i, j;
+
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++)
+		if (wl->rx_filter_rules[i].in_use)
+			break;
+
+	if (i == WL1271_MAX_RX_DATA_FILTERS)
+		return;
+
+	/* the ethertype is the last word of the 8-byte LLC/SNAP header */
+	hdrlen = ieee80211_hdrlen(hdr->frame_control);
+	if (skb->len < hdrlen + 8)
+		return;
+
+	memcpy(frame, ieee80211_get_DA(hdr), ETH_ALEN);
+	memcpy(frame + ETH_ALEN, ieee80211_get_SA(hdr), ETH_ALEN);
+	len = min_t(unsigned int, skb->len - hdrlen - 6,
+		    sizeof(frame) - 2 * ETH_ALEN);
+	memcpy(frame + 2 * ETH_ALEN, skb->data + hdrlen + 6, len);
+	len += 2 * ETH_ALEN;
+
+	for (; i < WL1271_MAX_RX_DATA_FILTERS; i++) {
+		rule = &wl->rx_filter_rules[i];
+		if (!rule->in_use || rule->len > len)
+			continue;
+
+		for (j = 0; j < rule->len; j++)
+			if ((rule->mask[j / 8] & BIT(j % 8)) &&
+			    frame[j] != rule->pattern[j])
+				break;
+
+		if (j == rule->len) {
+			rule->host_hits++;
+			return;
+		}
+	}
+}
+
 static int wl1271_rx_handle_data(struct wl1271 *wl, u8 *data, u32 length,
 				 enum wl_rx_buf_align rx_align, u8 *hlid)
 {
@@ -180,11 +231,29 @@ static int wl1271_rx_handle_data(struct wl1271 *wl, u8 *data, u32 length,
 	*hlid = desc->hlid;
 
 	hdr = (struct ieee80211_hdr *)skb->data;
+
+	if (wl->scan.state != WL1271_SCAN_STATE_IDLE &&
+	    (ieee80211_is_beacon(hdr->frame_control) ||
+	     ieee80211_is_probe_resp(hdr->frame_control)) &&
+	    wlcore_scan_rx_dup(wl, skb, desc->channel)) {
+		dev_kfree_skb(skb);
+		return 0;
+	}
 	if (ieee80211_is_beacon(hdr->frame_control))
 		beacon = 1;
 	if (ieee80211_is_data_present(hdr->frame_control))
 		is_data = 1;
 
+	if (is_data)
+		wlcore_rx_filters_count(wl, skb);
+
+	if (ieee80211_is_data_qos(hdr->frame_control) &&
+	    desc->hlid < WL12XX_MAX_LINKS)
+		wlcore_ba_mgr_rx(wl, desc->hlid,
+				 *ieee80211_get_qos_ctl(hdr) &
+				 IEEE80211_QOS_CTL_TID_MASK,
+				 pkt_data_len);
+
 	wl1271_rx_status(wl, desc, IEEE80211_SKB_RXCB(skb), beacon);
 	wlcore_hw_set_rx_csum(wl, desc, skb);
 
@@ -345,3 +414,90 @@ void wl1271_rx_data_filters_clear_all(struct wl1271 *wl)
 		wl1271_rx_data_filter_enable(wl, i, 0, NULL);
 	}
 }
+
+/*
+ * Program the runtime RX filter rules into the FW data filter slots while a
+ * STA role is associated, and take them out otherwise. The FW acts on the
+ * first matching slot, so a PASS rule punches a hole in a broader DROP rule
+ * in a higher slot. Frames matching no rule are passed to the host.
+ * Must be called with wl->mutex held and the chip awake.
+ */
+int wlcore_rx_filters_apply(struct wl1271 *wl)
+{
+	struct cfg80211_wowlan_trig_pkt_pattern p;
+	struct wl12xx_rx_data_filter *filter;
+	struct wlcore_rx_filter_rule *rule;
+	struct wl12xx_vif *wlvif;
+	bool assoc = false, want = false;
+	int i, ret;
+
+	/* while suspended the FW filters belong to WoWLAN */
+	if (wl->wow_enabled)
+		return 0;
+
+	wl12xx_for_each_wlvif_sta(wl, wlvif) {
+		if (test_bit(WLVIF_FLAG_STA_ASSOCIATED, &wlvif->flags))
+			assoc = true;
+	}
+
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++) {
+		rule = &wl->rx_filter_rules[i];
+		rule->in_fw = false;
+
+		if (assoc && rule->in_use &&
+		    rule->action != WLCORE_RX_FILTER_RULE_COUNT)
+			want = true;
+	}
+
+	if (wl->rx_filters_active) {
+		ret = wl1271_rx_data_filtering_enable(wl, 0, FILTER_SIGNAL);
+		if (ret < 0)
+			return ret;
+
+		wl->rx_filters_active = false;
+	}
+
+	wl1271_rx_data_filters_clear_all(wl);
+
+	if (!want)
+		return 0;
+
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++) {
+		rule = &wl->rx_filter_rules[i];
+		if (!rule->in_use ||
+		    rule->action == WLCORE_RX_FILTER_RULE_COUNT)
+			continue;
+
+		p.pattern = rule->pattern;
+		p.mask = rule->mask;
+		p.pattern_len = rule->len;
+
+		ret = wl1271_convert_wowlan_pattern_to_rx_filter(&p, &filter);
+		if (ret < 0)
+			goto out_clear;
+
+		if (rule->action == WLCORE_RX_FILTER_RULE_DROP)
+			filter->action = FILTER_DROP;
+
+		ret = wl1271_rx_data_filter_enable(wl, i, 1, filter);
+		kfree(filter);
+		if (ret < 0)
+			goto out_clear;
+
+		rule->in_fw = true;
+	}
+
+	ret = wl1271_rx_data_filtering_enable(wl, 1, FILTER_SIGNAL);
+	if (ret < 0)
+		goto out_clear;
+
+	wl->rx_filters_active = true;
+	return 0;
+
+out_clear:
+	wl1271_rx_data_filters_clear_all(wl);
+	for (i = 0; i < WL1271_MAX_RX_DATA_FILTERS; i++)
+		wl->rx_filter_rules[i].in_fw = false;
+
+	return ret;
+}
@@ -153,6 +153,10 @@ int wl1271_rx_data_filter_enable(struct wl1271 *wl,
 				 bool enable,
 				 struct wl12xx_rx_data_filter *filter);
 void wl1271_rx_data_filters_clear_all(struct wl1271 *wl);
+int wlcore_rx_filters_apply(struct wl1271 *wl);
+int wl1271_convert_wowlan_pattern_to_rx_filter(
+	struct cfg80211_wowlan_trig_pkt_pattern *p,
+	struct wl12xx_rx_data_filter **f);
 u8 wlcore_rate_to_idx(struct wl1271 *wl, u8 rate, enum ieee80211_band band);
 
 #endif
@@ -22,6 +22,8 @@
  */
 
 #include <linux/ieee80211.h>
+#include <linux/etherdevice.h>
+#include <linux/crc32.h>
 
 #include "wlcore.h"
 #include "debug.h"
@@ -55,6 +57,9 @@ void wl1271_scan_complete_work(struct work_struct *work)
 	vif = wl->scan_vif;
 	wlvif = wl12xx_vif_to_data(vif);
 
+	wl1271_debug(DEBUG_SCAN, "%u duplicate scan results dropped",
+		     wl->scan.dup_dropped);
+
 	wl->scan.state = WL1271_SCAN_STATE_IDLE;
 	memset(wl->scan.scanned_ch, 0, sizeof(wl->scan.scanned_ch));
 	wl->scan.req = NULL;
@@ -171,32 +176,19 @@ static int wl1271_get_scan_channels(struct wl1271 *wl,
 
 #define WL1271_NOTHING_TO_SCAN 1
 
-static int wl1271_scan_send(struct wl1271 *wl, struct ieee80211_vif *vif,
-			    enum ieee80211_band band,
-			    bool passive, u32 basic_rate)
+/*
+ * Fill in the part of a band's scan command that is the same for its
+ * active and passive passes. It is built once per scan request, the passes
+ * only set the options and the channels.
+ */
+static int wl1271_scan_prepare_cmd(struct wl1271 *wl,
+				   struct ieee80211_vif *vif,
+				   enum ieee80211_band band, u32 basic_rate)
 {
 	struct wl12xx_vif *wlvif = wl12xx_vif_to_data(vif);
-	struct wl1271_cmd_scan *cmd;
-	struct wl1271_cmd_trigger_scan_to *trigger;
-	int ret;
-	u16 scan_options = 0;
+	struct wl1271_cmd_scan *cmd = wl->scan.cmd[band];
 
-	/* skip active scans if we don't have SSIDs */
-	if (!passive && wl->scan.req->n_ssids == 0)
-		return WL1271_NOTHING_TO_SCAN;
-
-	cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
-	trigger = kzalloc(sizeof(*trigger), GFP_KERNEL);
-	if (!cmd || !trigger) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	if (wl->conf.scan.split_scan_timeout)
-		scan_options |= WL1271_SCAN_OPT_SPLIT_SCAN;
-
-	if (passive)
-		scan_options |= WL1271_SCAN_OPT_PASSIVE;
+	memset(cmd, 0, sizeof(*cmd));
 
 	if (wlvif->bss_type == BSS_TYPE_AP_BSS ||
 	    test_bit(WLVIF_FLAG_STA_ASSOCIATED, &wlvif->flags))
@@ -204,23 +196,10 @@ static int wl1271_scan_send(struct wl1271 *wl, struct ieee80211_vif *vif,
 	else
 		cmd->params.role_id = wlvif->dev_role_id;
 
-	if (WARN_ON(cmd->params.role_id == WL12XX_INVALID_ROLE_ID)) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	cmd->params.scan_options = cpu_to_le16(scan_options);
-
-	cmd->params.n_ch = wl1271_get_scan_channels(wl, wl->scan.req,
-						    cmd->channels,
-						    band, passive);
-	if (cmd->params.n_ch == 0) {
-		ret = WL1271_NOTHING_TO_SCAN;
-		goto out;
-	}
+	if (WARN_ON(cmd->params.role_id == WL12XX_INVALID_ROLE_ID))
+		return -EINVAL;
 
 	cmd->params.tx_rate = cpu_to_le32(basic_rate);
-	cmd->params.n_probe_reqs = wl->conf.scan.num_probe_reqs;
 	cmd->params.tid_trigger = CONF_TX_AC_ANY_TID;
 	cmd->params.scan_tag = WL1271_SCAN_DEFAULT_TAG;
 
@@ -241,35 +220,80 @@ static int wl1271_scan_send(struct wl1271 *wl, struct ieee80211_vif *vif,
 
 	memcpy(cmd->addr, vif->addr, ETH_ALEN);
 
-	ret = wl12xx_cmd_build_probe_req(wl, wlvif,
-					 cmd->params.role_id, band,
-					 wl->scan.ssid, wl->scan.ssid_len,
-					 wl->scan.req->ie,
-					 wl->scan.req->ie_len);
-	if (ret < 0) {
-		wl1271_error("PROBE request template failed");
-		goto out;
+	__set_bit(band, &wl->scan.cmd_ready);
+
+	return 0;
+}
+
+static int wl1271_scan_send(struct wl1271 *wl, struct ieee80211_vif *vif,
+			    enum ieee80211_band band,
+			    bool passive, u32 basic_rate)
+{
+	struct wl12xx_vif *wlvif = wl12xx_vif_to_data(vif);
+	struct wl1271_cmd_scan *cmd = wl->scan.cmd[band];
+	struct wl1271_cmd_trigger_scan_to *trigger = wl->scan.trigger;
+	int ret;
+	u16 scan_options = 0;
+
+	/* skip active scans if we don't have SSIDs */
+	if (!passive && wl->scan.req->n_ssids == 0)
+		return WL1271_NOTHING_TO_SCAN;
+
+	if (!test_bit(band, &wl->scan.cmd_ready)) {
+		ret = wl1271_scan_prepare_cmd(wl, vif, band, basic_rate);
+		if (ret < 0)
+			return ret;
 	}
 
-	trigger->timeout = cpu_to_le32(wl->conf.scan.split_scan_timeout);
-	ret = wl1271_cmd_send(wl, CMD_TRIGGER_SCAN_TO, trigger,
-			      sizeof(*trigger), 0);
-	if (ret < 0) {
-		wl1271_error("trigger scan to failed for hw scan");
-		goto out;
+	if (wl->conf.scan.split_scan_timeout)
+		scan_options |= WL1271_SCAN_OPT_SPLIT_SCAN;
+
+	if (passive)
+		scan_options |= WL1271_SCAN_OPT_PASSIVE;
+
+	cmd->params.scan_options = cpu_to_le16(scan_options);
+
+	cmd->params.n_ch = wl1271_get_scan_channels(wl, wl->scan.req,
+						    cmd->channels,
+						    band, passive);
+	if (cmd->params.n_ch == 0)
+		return WL1271_NOTHING_TO_SCAN;
+
+	/* no probe requests are sent on a passive pass */
+	if (!passive) {
+		ret = wl12xx_cmd_build_probe_req(wl, wlvif,
+						 cmd->params.role_id, band,
+						 wl->scan.ssid,
+						 wl->scan.ssid_len,
+						 wl->scan.req->ie,
+						 wl->scan.req->ie_len);
+		if (ret < 0) {
+			wl1271_error("PROBE request template failed");
+			return ret;
+		}
+	}
+
+	/* the split scan timeout holds for the whole scan request */
+	if (!wl->scan.trigger_sent) {
+		memset(trigger, 0, sizeof(*trigger));
+		trigger->timeout =
+			cpu_to_le32(wl->conf.scan.split_scan_timeout);
+		ret = wl1271_cmd_send(wl, CMD_TRIGGER_SCAN_TO, trigger,
+				      sizeof(*trigger), 0);
+		if (ret < 0) {
+			wl1271_error("trigger scan to failed for hw scan");
+			return ret;
+		}
+
+		wl->scan.trigger_sent = true;
 	}
 
 	wl1271_dump(DEBUG_SCAN, "SCAN: ", cmd, sizeof(*cmd));
 
 	ret = wl1271_cmd_send(wl, CMD_SCAN, cmd, sizeof(*cmd), 0);
-	if (ret < 0) {
+	if (ret < 0)
 		wl1271_error("SCAN failed");
-		goto out;
-	}
 
-out:
-	kfree(cmd);
-	kfree(trigger);
 	return ret;
 }
 
@@ -387,6 +411,10 @@ int wl1271_scan(struct wl1271 *wl, struct ieee80211_vif *vif,
 	wl->scan_vif = vif;
 	wl->scan.req = req;
 	memset(wl->scan.scanned_ch, 0, sizeof(wl->scan.scanned_ch));
+	wl->scan.cmd_ready = 0;
+	wl->scan.trigger_sent = false;
+	wl->scan.n_seen = 0;
+	wl->scan.dup_dropped = 0;
 
 	/* we assume failure so that timeout scenarios are handled correctly */
 	wl->scan.failed = true;
@@ -398,6 +426,100 @@ int wl1271_scan(struct wl1271 *wl, struct ieee80211_vif *vif,
 	return 0;
 }
 
+/*
+ * While scanning, the FW hands up the same beacons and probe responses
+ * over and over, one per probe request and beacon interval of the dwell
+ * time. Catch the copies whose content didn't change, so they don't go
+ * through mac80211 and the cfg80211 BSS cache update again. The BSS of
+ * an associated STA role is left alone, mac80211 tracks its beacons.
+ */
+bool wlcore_scan_rx_dup(struct wl1271 *wl, struct sk_buff *skb, u8 channel)
+{
+	struct ieee80211_mgmt *mgmt = (struct ieee80211_mgmt *)skb->data;
+	size_t hdr_len = offsetof(struct ieee80211_mgmt, u.beacon.variable);
+	struct wlcore_scan_seen *seen;
+	struct wl12xx_vif *wlvif;
+	struct ieee80211_vif *vif;
+	__le16 stype;
+	u32 crc;
+	int i;
+
+	if (skb->len < hdr_len)
+		return false;
+
+	wl12xx_for_each_wlvif_sta(wl, wlvif) {
+		vif = wl12xx_wlvif_to_vif(wlvif);
+		if (test_bit(WLVIF_FLAG_STA_ASSOCIATED, &wlvif->flags) &&
+		    !compare_ether_addr(vif->bss_conf.bssid, mgmt->bssid))
+			return false;
+	}
+
+	/* the timestamp differs in every copy, leave it out */
+	hdr_len = offsetof(struct ieee80211_mgmt, u.beacon.beacon_int);
+	crc = crc32_le(~0, skb->data + hdr_len, skb->len - hdr_len);
+	stype = mgmt->frame_control & cpu_to_le16(IEEE80211_FCTL_STYPE);
+
+	for (i = 0; i < wl->scan.n_seen; i++) {
+		seen = &wl->scan.seen[i];
+		if (seen->channel != channel || seen->stype != stype ||
+		    compare_ether_addr(seen->bssid, mgmt->bssid))
+			continue;
+
+		if (seen->crc == crc) {
+			wl->scan.dup_dropped++;
+			return true;
+		}
+
+		seen->crc = crc;
+		return false;
+	}
+
+	if (wl->scan.n_seen < WLCORE_SCAN_SEEN_MAX) {
+		seen = &wl->scan.seen[wl->scan.n_seen++];
+		memcpy(seen->bssid, mgmt->bssid, ETH_ALEN);
+		seen->channel = channel;
+		seen->stype = stype;
+		seen->crc = crc;
+	}
+
+	return false;
+}
+
+int wlcore_scan_alloc(struct wl1271 *wl)
+{
+	int i;
+
+	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
+		wl->scan.cmd[i] = kzalloc(sizeof(*wl->scan.cmd[i]),
+					  GFP_KERNEL);
+		if (!wl->scan.cmd[i])
+			goto err;
+	}
+
+	wl->scan.trigger = kzalloc(sizeof(*wl->scan.trigger), GFP_KERNEL);
+	if (!wl->scan.trigger)
+		goto err;
+
+	return 0;
+
+err:
+	wlcore_scan_free(wl);
+	return -ENOMEM;
+}
+
+void wlcore_scan_free(struct wl1271 *wl)
+{
+	int i;
+
+	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
+		kfree(wl->scan.cmd[i]);
+		wl->scan.cmd[i] = NULL;
+	}
+
+	kfree(wl->scan.trigger);
+	wl->scan.trigger = NULL;
+}
+
 int wl1271_scan_stop(struct wl1271 *wl)
 {
 	struct wl1271_cmd_header *cmd = NULL;
@@ -34,6 +34,9 @@ int wl1271_scan_build_probe_req(struct wl1271 *wl,
 				const u8 *ssid, size_t ssid_len,
 				const u8 *ie, size_t ie_len, u8 band);
 void wl1271_scan_stm(struct wl1271 *wl, struct ieee80211_vif *vif);
+bool wlcore_scan_rx_dup(struct wl1271 *wl, struct sk_buff *skb, u8 channel);
+int wlcore_scan_alloc(struct wl1271 *wl);
+void wlcore_scan_free(struct wl1271 *wl);
 void wl1271_scan_complete_work(struct work_struct *work);
 int wl1271_scan_sched_scan_config(struct wl1271 *wl,
 				     struct wl12xx_vif *wlvif,
@@ -24,6 +24,7 @@
 #include <linux/irq.h>
 #include <linux/module.h>
 #include <linux/vmalloc.h>
+#include <linux/scatterlist.h>
 #include <linux/platform_device.h>
 #include <linux/mmc/sdio.h>
 #include <linux/mmc/sdio_func.h>
@@ -52,6 +53,10 @@ static bool dump = false;
 struct wl12xx_sdio_glue {
 	struct device *dev;
 	struct platform_device *core;
+
+	/* CMD53 requests, one in flight while the other is prepared */
+	struct sdio_sg_req sg_req[2];
+	struct scatterlist sg[2];
 };
 
 static const struct sdio_device_id wl1271_devices[] __devinitconst = {
@@ -71,6 +76,48 @@ static void wl1271_sdio_set_block_size(struct device *child,
 	sdio_release_host(func);
 }
 
+/*
+ * Move a buffer as a series of CMD53s, letting the host prepare (e.g.
+ * DMA map) the next chunk while the previous one is on the bus.
+ */
+static int wl12xx_sdio_raw_ext(struct wl12xx_sdio_glue *glue,
+			       struct sdio_func *func, int addr, void *buf,
+			       size_t len, bool fixed, bool write)
+{
+	struct sdio_sg_req *req;
+	unsigned int chunk;
+	int i = 0, ret = 0, wait_ret;
+
+	while (len) {
+		/* the chunk is described by a single sg entry */
+		chunk = sdio_sg_req_size(func, len, 1);
+		req = &glue->sg_req[i];
+
+		sg_init_one(&glue->sg[i], buf, chunk);
+		memset(req, 0, sizeof(*req));
+		req->sg = &glue->sg[i];
+		req->sg_len = 1;
+		req->addr = addr;
+		req->size = chunk;
+		req->write = write;
+		req->incr_addr = !fixed;
+
+		ret = sdio_start_sg_req(func, req);
+		if (ret)
+			break;
+
+		buf += chunk;
+		len -= chunk;
+		if (!fixed)
+			addr += chunk;
+		i ^= 1;
+	}
+
+	wait_ret = sdio_wait_sg_req(func);
+
+	return ret ? ret : wait_ret;
+}
+
 static void wl12xx_sdio_raw_read(struct device *child, int addr, void *buf,
 				 size_t len, bool fixed)
 {
@@ -92,10 +139,8 @@ static void wl12xx_sdio_raw_read(struct device *child, int addr, void *buf,
 		dev_dbg(child->parent, "sdio read 52 addr 0x%x, byte 0x%02x\n",
 			addr, ((u8 *)buf)[0]);
 	} else {
-		if (fixed)
-			ret = sdio_readsb(func, buf, addr, len);
-		else
-			ret = sdio_memcpy_fromio(func, buf, addr, len);
+		ret = wl12xx_sdio_raw_ext(glue, func, addr, buf, len, fixed,
+					  false);
 
 		dev_dbg(child->parent, "sdio read 53 addr 0x%x, %zu bytes\n",
 			addr, len);
@@ -131,10 +176,8 @@ static void wl12xx_sdio_raw_write(struct device *child, int addr, void *buf,
 		dev_dbg(child->parent, "sdio write 53 addr 0x%x, %zu bytes\n",
 			addr, len);
 
-		if (fixed)
-			ret = sdio_writesb(func, addr, buf, len);
-		else
-			ret = sdio_memcpy_toio(func, addr, buf, len);
+		ret = wl12xx_sdio_raw_ext(glue, func, addr, buf, len, fixed,
+					  true);
 	}
 
 	sdio_release_host(func);
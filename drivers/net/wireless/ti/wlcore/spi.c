@@ -68,9 +68,32 @@
 
 #define WSPI_MAX_NUM_OF_CHUNKS (WL1271_AGGR_BUFFER_SIZE / WSPI_MAX_CHUNK_SIZE)
 
+/*
+ * State of a chained read: each message carries the data of the chunk
+ * whose busy word was just seen ready, followed by the command and busy
+ * word of the next chunk. See wl12xx_spi_raw_read().
+ */
+struct wl12xx_spi_read {
+	struct spi_message msg;
+	struct spi_transfer t[3];
+	struct completion done;
+
+	u32 *cmd;
+	u32 *busy_buf;
+	u8 *buf;		/* where the commanded chunk goes */
+	u32 chunk_len;		/* length of the commanded chunk, if any */
+	int addr;		/* start of the next chunk */
+	size_t left;		/* bytes not commanded yet */
+	bool fixed;
+
+	bool miss;		/* chunk not ready after the busy words */
+	int status;
+};
+
 struct wl12xx_spi_glue {
 	struct device *dev;
 	struct platform_device *core;
+	struct wl12xx_spi_read rd;
 };
 
 static void wl12xx_spi_reset(struct device *child)
@@ -193,68 +216,139 @@ static int wl12xx_spi_read_busy(struct device *child)
 	return -ETIMEDOUT;
 }
 
-static void wl12xx_spi_raw_read(struct device *child, int addr, void *buf,
-				size_t len, bool fixed)
+static void wl12xx_spi_read_complete(void *context);
+
+/*
+ * Queue the data transfer of the chunk that was commanded last (if any)
+ * together with the command and busy words of the next chunk (if any).
+ */
+static int wl12xx_spi_read_queue(struct wl12xx_spi_glue *glue)
 {
-	struct wl12xx_spi_glue *glue = dev_get_drvdata(child->parent);
-	struct wl1271 *wl = dev_get_drvdata(child);
-	struct spi_transfer t[2];
-	struct spi_message m;
-	u32 *busy_buf;
-	u32 *cmd;
-	u32 chunk_len;
+	struct wl12xx_spi_read *rd = &glue->rd;
+	struct spi_transfer *t = rd->t;
 
-	while (len > 0) {
-		chunk_len = min((size_t)WSPI_MAX_CHUNK_SIZE, len);
+	spi_message_init(&rd->msg);
+	memset(rd->t, 0, sizeof(rd->t));
 
-		cmd = &wl->buffer_cmd;
-		busy_buf = wl->buffer_busyword;
+	if (rd->chunk_len) {
+		t->rx_buf = rd->buf;
+		t->len = rd->chunk_len;
+		t->cs_change = true;
+		spi_message_add_tail(t++, &rd->msg);
 
-		*cmd = 0;
-		*cmd |= WSPI_CMD_READ;
-		*cmd |= (chunk_len << WSPI_CMD_BYTE_LENGTH_OFFSET) &
-			WSPI_CMD_BYTE_LENGTH;
-		*cmd |= addr & WSPI_CMD_BYTE_ADDR;
+		rd->buf += rd->chunk_len;
+	}
 
-		if (fixed)
-			*cmd |= WSPI_CMD_FIXED;
+	rd->chunk_len = min_t(size_t, WSPI_MAX_CHUNK_SIZE, rd->left);
+	if (rd->chunk_len) {
+		*rd->cmd = 0;
+		*rd->cmd |= WSPI_CMD_READ;
+		*rd->cmd |= (rd->chunk_len << WSPI_CMD_BYTE_LENGTH_OFFSET) &
+			WSPI_CMD_BYTE_LENGTH;
+		*rd->cmd |= rd->addr & WSPI_CMD_BYTE_ADDR;
 
-		spi_message_init(&m);
-		memset(t, 0, sizeof(t));
+		if (rd->fixed)
+			*rd->cmd |= WSPI_CMD_FIXED;
 
-		t[0].tx_buf = cmd;
-		t[0].len = 4;
-		t[0].cs_change = true;
-		spi_message_add_tail(&t[0], &m);
+		t->tx_buf = rd->cmd;
+		t->len = 4;
+		t->cs_change = true;
+		spi_message_add_tail(t++, &rd->msg);
 
 		/* Busy and non busy words read */
-		t[1].rx_buf = busy_buf;
-		t[1].len = WL1271_BUSY_WORD_LEN;
-		t[1].cs_change = true;
-		spi_message_add_tail(&t[1], &m);
+		t->rx_buf = rd->busy_buf;
+		t->len = WL1271_BUSY_WORD_LEN;
+		t->cs_change = true;
+		spi_message_add_tail(t++, &rd->msg);
+
+		if (!rd->fixed)
+			rd->addr += rd->chunk_len;
+		rd->left -= rd->chunk_len;
+	}
 
-		spi_sync(to_spi_device(glue->dev), &m);
+	rd->msg.complete = wl12xx_spi_read_complete;
+	rd->msg.context = glue;
+
+	return spi_async(to_spi_device(glue->dev), &rd->msg);
+}
 
-		if (!(busy_buf[WL1271_BUSY_WORD_CNT - 1] & 0x1) &&
-		    wl12xx_spi_read_busy(child)) {
-			memset(buf, 0, chunk_len);
-			return;
-		}
+/*
+ * Runs in the SPI master's completion context: chain the next message
+ * straight away if the chunk just commanded is ready, otherwise hand
+ * back to wl12xx_spi_raw_read() to poll for it.
+ */
+static void wl12xx_spi_read_complete(void *context)
+{
+	struct wl12xx_spi_glue *glue = context;
+	struct wl12xx_spi_read *rd = &glue->rd;
 
-		spi_message_init(&m);
-		memset(t, 0, sizeof(t));
+	if (rd->msg.status) {
+		rd->status = rd->msg.status;
+		goto done;
+	}
 
-		t[0].rx_buf = buf;
-		t[0].len = chunk_len;
-		t[0].cs_change = true;
-		spi_message_add_tail(&t[0], &m);
+	/* that was the data of the last chunk */
+	if (!rd->chunk_len)
+		goto done;
 
-		spi_sync(to_spi_device(glue->dev), &m);
+	if (!(rd->busy_buf[WL1271_BUSY_WORD_CNT - 1] & 0x1)) {
+		rd->miss = true;
+		goto done;
+	}
 
-		if (!fixed)
-			addr += chunk_len;
-		buf += chunk_len;
-		len -= chunk_len;
+	rd->status = wl12xx_spi_read_queue(glue);
+	if (!rd->status)
+		return;
+
+done:
+	complete(&rd->done);
+}
+
+static void wl12xx_spi_raw_read(struct device *child, int addr, void *buf,
+				size_t len, bool fixed)
+{
+	struct wl12xx_spi_glue *glue = dev_get_drvdata(child->parent);
+	struct wl1271 *wl = dev_get_drvdata(child);
+	struct wl12xx_spi_read *rd = &glue->rd;
+	int ret;
+
+	if (!len)
+		return;
+
+	rd->cmd = &wl->buffer_cmd;
+	rd->busy_buf = wl->buffer_busyword;
+	rd->buf = buf;
+	rd->chunk_len = 0;
+	rd->addr = addr;
+	rd->left = len;
+	rd->fixed = fixed;
+	rd->status = 0;
+
+	/*
+	 * The whole transfer completes in the SPI master's context as long
+	 * as the fixed busy words suffice; only fall back to polling for
+	 * further busy words from here when a chunk was not ready in time.
+	 */
+	do {
+		rd->miss = false;
+		INIT_COMPLETION(rd->done);
+
+		ret = wl12xx_spi_read_queue(glue);
+		if (ret)
+			break;
+
+		wait_for_completion(&rd->done);
+		ret = rd->status;
+		if (ret)
+			break;
+
+		if (rd->miss)
+			ret = wl12xx_spi_read_busy(child);
+	} while (!ret && rd->miss);
+
+	if (ret) {
+		dev_err(child->parent, "SPI read failed (%d)\n", ret);
+		memset(buf, 0, len);
 	}
 }
 
@@ -336,6 +430,7 @@ static int __devinit wl1271_probe(struct spi_device *spi)
 	}
 
 	glue->dev = &spi->dev;
+	init_completion(&glue->rd.done);
 
 	spi_set_drvdata(spi, glue);
 
@@ -32,6 +32,7 @@
 #include "tx.h"
 #include "event.h"
 #include "hw_ops.h"
+#include "acx.h"
 
 /*
  * TODO: this is here just for now, it must be removed when the data
@@ -195,6 +196,7 @@ static int wl1271_tx_allocate(struct wl1271 *wl, struct wl12xx_vif *wlvif,
 	u32 total_blocks;
 	int id, ret = -EBUSY, ac;
 	u32 spare_blocks;
+	u32 reserved = 0;
 
 	if (buf_offset + total_len > WL1271_AGGR_BUFFER_SIZE)
 		return -EAGAIN;
@@ -208,7 +210,14 @@ static int wl1271_tx_allocate(struct wl1271 *wl, struct wl12xx_vif *wlvif,
 
 	total_blocks = wlcore_hw_calc_tx_blocks(wl, total_len, spare_blocks);
 
-	if (total_blocks <= wl->tx_blocks_available) {
+	/*
+	 * Leave the blocks held back for RX alone, unless nothing is
+	 * allocated (no TX status would come to retry on).
+	 */
+	if (wl->tx_allocated_blocks)
+		reserved = wl->mem_adapt.tx_blocks_reserved;
+
+	if (total_blocks + reserved <= wl->tx_blocks_available) {
 		desc = (struct wl1271_tx_hw_descr *)skb_push(
 			skb, total_len - skb->len);
 
@@ -242,6 +251,12 @@ static int wl1271_tx_allocate(struct wl1271 *wl, struct wl12xx_vif *wlvif,
 			     total_len, total_blocks, id);
 	} else {
 		wl1271_free_tx_id(wl, id);
+
+		if (wl->conf.mem.tx_adapt_max_blocks &&
+		    !wl->mem_adapt.stalled) {
+			wl->mem_adapt.stalled = true;
+			wl->mem_adapt.stall_start = jiffies;
+		}
 	}
 
 	return ret;
@@ -1081,6 +1096,132 @@ out:
 }
 EXPORT_SYMBOL_GPL(wl1271_tx_flush);
 
+/* ms */
+#define WLCORE_MEM_ADAPT_PERIOD		1000
+/* TX stall time per period (ms) that makes us release held back blocks */
+#define WLCORE_MEM_ADAPT_STALL_THOLD	50
+#define WLCORE_MEM_ADAPT_STEP		4
+
+static void wlcore_mem_adapt_stall_account(struct wlcore_mem_adapt *ma)
+{
+	unsigned int ms = jiffies_to_msecs(jiffies - ma->stall_start);
+
+	ma->stall_ms += ms;
+	ma->stall_ms_total += ms;
+	ma->stall_start = jiffies;
+}
+
+static void wlcore_mem_adapt_arm(struct wl1271 *wl)
+{
+	struct wlcore_mem_adapt *ma = &wl->mem_adapt;
+
+	if (!wl->conf.mem.tx_adapt_max_blocks || !wl->stats.fw_stats)
+		return;
+
+	if (!delayed_work_pending(&ma->work))
+		ieee80211_queue_delayed_work(wl->hw, &ma->work,
+				msecs_to_jiffies(WLCORE_MEM_ADAPT_PERIOD));
+}
+
+/* called when the FW freed TX blocks, ends a TX memory stall if any */
+void wlcore_mem_adapt_stall_end(struct wl1271 *wl)
+{
+	struct wlcore_mem_adapt *ma = &wl->mem_adapt;
+
+	if (!ma->stalled)
+		return;
+
+	wlcore_mem_adapt_stall_account(ma);
+	ma->stalled = false;
+
+	wlcore_mem_adapt_arm(wl);
+}
+
+/*
+ * Called after RX frames were handled. The FW only reports RX overflows
+ * through its statistics, so RX traffic arms a check as well, otherwise
+ * a reserve would never be built up before TX stalled once.
+ */
+void wlcore_mem_adapt_rx(struct wl1271 *wl)
+{
+	wlcore_mem_adapt_arm(wl);
+}
+
+/*
+ * Hold back some of the free TX memory blocks while the FW reports RX
+ * overflows, so the FW's dynamic memory can keep them for RX, and
+ * release them again while TX keeps stalling on FW memory. Only the
+ * host side TX accounting is adapted, the FW memory configuration is
+ * left as it was set at init time.
+ */
+void wlcore_mem_adapt_work(struct work_struct *work)
+{
+	struct delayed_work *dwork;
+	struct wl1271 *wl;
+	struct wlcore_mem_adapt *ma;
+	u32 overflows;
+	bool rx_overflow;
+	int reserved;
+
+	dwork = container_of(work, struct delayed_work, work);
+	ma = container_of(dwork, struct wlcore_mem_adapt, work);
+	wl = container_of(ma, struct wl1271, mem_adapt);
+
+	mutex_lock(&wl->mutex);
+
+	if (unlikely(wl->state != WL1271_STATE_ON) || !wl->stats.fw_stats)
+		goto out;
+
+	/*
+	 * The RX overflow count comes from the FW statistics. Refresh them
+	 * only if the chip is awake anyway and nobody else did so during
+	 * the last period: a sleeping chip isn't overflowing, and waking
+	 * it up here would stall the data path for nothing.
+	 */
+	if (!test_bit(WL1271_FLAG_IN_ELP, &wl->flags) &&
+	    !test_bit(WL1271_FLAG_RECOVERY_IN_PROGRESS, &wl->flags) &&
+	    time_after(jiffies, wl->stats.fw_stats_update +
+		       msecs_to_jiffies(WLCORE_MEM_ADAPT_PERIOD)) &&
+	    !wl1271_acx_statistics(wl, wl->stats.fw_stats))
+		wl->stats.fw_stats_update = jiffies;
+
+	/* a stall that is still going on counts towards this period */
+	if (ma->stalled)
+		wlcore_mem_adapt_stall_account(ma);
+
+	overflows = wlcore_hw_get_rx_mem_overflows(wl);
+	rx_overflow = overflows != ma->rx_overflows;
+	ma->rx_overflows = overflows;
+
+	ma->stall_ms_last = ma->stall_ms;
+	ma->stall_ms = 0;
+
+	reserved = ma->tx_blocks_reserved;
+	if (rx_overflow)
+		reserved = min_t(int, reserved + WLCORE_MEM_ADAPT_STEP,
+				 wl->conf.mem.tx_adapt_max_blocks);
+	else if (ma->stall_ms_last >= WLCORE_MEM_ADAPT_STALL_THOLD)
+		reserved = max(reserved - WLCORE_MEM_ADAPT_STEP, 0);
+
+	if (reserved != ma->tx_blocks_reserved) {
+		if (reserved < ma->tx_blocks_reserved)
+			ma->stall_ms_released = ma->stall_ms_last;
+		ma->tx_blocks_reserved = reserved;
+
+		wl1271_debug(DEBUG_TX, "mem adapt: %d TX blocks held back "
+			     "(TX stalled %u ms in the last period)",
+			     reserved, ma->stall_ms_last);
+	}
+
+	/* keep watching the RX side while blocks are held back */
+	if (ma->tx_blocks_reserved)
+		ieee80211_queue_delayed_work(wl->hw, &ma->work,
+				msecs_to_jiffies(WLCORE_MEM_ADAPT_PERIOD));
+
+out:
+	mutex_unlock(&wl->mutex);
+}
+
 u32 wl1271_tx_min_rate_get(struct wl1271 *wl, u32 rate_set)
 {
 	if (WARN_ON(!rate_set))
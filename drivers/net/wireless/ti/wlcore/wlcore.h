@@ -75,6 +75,8 @@ struct wlcore_ops {
 	int (*handle_static_data)(struct wl1271 *wl,
 				  struct wl1271_static_data *static_data);
 	int (*get_spare_blocks)(struct wl1271 *wl, bool is_gem);
+	u32 (*get_rx_mem_overflows)(struct wl1271 *wl);
+	u32 (*get_rx_filter_drops)(struct wl1271 *wl);
 	int (*set_key)(struct wl1271 *wl, enum set_key_cmd cmd,
 		       struct ieee80211_vif *vif,
 		       struct ieee80211_sta *sta,
@@ -129,14 +131,64 @@ enum wlcore_registers {
 };
 
 struct wl1271_stats {
+	/* last FW statistics snapshot, allocated by the core at register */
 	void *fw_stats;
 	unsigned long fw_stats_update;
 	size_t fw_stats_len;
 
+	/*
+	 * Background sampler: the previous snapshot is kept so that rates
+	 * can be computed, and new samples are read into it before the two
+	 * buffers are swapped. Zero sample_interval (ms) disables it.
+	 */
+	void *fw_stats_prev;
+	unsigned long fw_stats_prev_update;
+	unsigned int sample_interval;
+	struct delayed_work sample_work;
+
 	unsigned int retry_count;
 	unsigned int excessive_retries;
 };
 
+/* Adaptive host side TX memory reserve, traded between TX and RX */
+struct wlcore_mem_adapt {
+	/* free TX memory blocks currently held back for RX */
+	u8 tx_blocks_reserved;
+
+	/* TX is stalled on FW memory blocks since stall_start */
+	bool stalled;
+	unsigned long stall_start;
+
+	/* TX stall time (ms) in the current and in the last window */
+	unsigned int stall_ms;
+	unsigned int stall_ms_last;
+
+	/* TX stall time (ms) in the window that caused the last release */
+	unsigned int stall_ms_released;
+	unsigned int stall_ms_total;
+
+	/* last cumulative RX out-of-memory count reported by the FW */
+	u32 rx_overflows;
+
+	struct delayed_work work;
+};
+
+/* RX BA session manager */
+struct wlcore_ba_mgr {
+	u32 granted;
+	u32 refused;
+	u32 evicted_idle;
+	u32 evicted_busy;
+
+	/*
+	 * periods left during which a session freed for a refused flow
+	 * is kept for the flows that were refused
+	 */
+	u8 reserve_periods;
+
+	struct delayed_work work;
+};
+
 struct wl1271 {
 	struct ieee80211_hw *hw;
 	bool mac80211_registered;
@@ -204,6 +256,9 @@ struct wl1271 {
 	u32 tx_pkts_freed[NUM_TX_QUEUES];
 	u32 tx_allocated_pkts[NUM_TX_QUEUES];
 
+	/* TX memory reserve for RX */
+	struct wlcore_mem_adapt mem_adapt;
+
 	/* Transmitted TX packets counter for chipset interface */
 	u32 tx_packets_count;
 
@@ -240,11 +295,20 @@ struct wl1271 {
 	/* Network stack work  */
 	struct work_struct netstack_work;
 
-	/* FW log buffer */
-	u8 *fwlog;
+	/* FW log ring buffer, header and tail pages followed by the data */
+	struct wlcore_fwlog_ring *fwlog;
 
-	/* Number of valid bytes in the FW log buffer */
-	ssize_t fwlog_size;
+	/* FW log ring state, mirrored to the header for consumers */
+	u32 fwlog_head;
+	u32 fwlog_flags;
+	u32 fwlog_dropped_bytes;
+	u32 fwlog_dropped_records;
+
+	/* Set when the FW log is going away, readers should bail out */
+	bool fwlog_closed;
+
+	/* Serializes the sysfs FW log entry readers */
+	struct mutex fwlog_mutex;
 
 	/* Sysfs FW log entry readers wait queue */
 	wait_queue_head_t fwlog_waitq;
@@ -338,6 +402,9 @@ struct wl1271 {
 	/* number of currently active RX BA sessions */
 	int ba_rx_session_count;
 
+	/* hands the RX BA sessions to the flows that carry traffic */
+	struct wlcore_ba_mgr ba_mgr;
+
 	/* AP-mode - number of currently connected stations */
 	int active_sta_count;
 
@@ -350,6 +417,13 @@ struct wl1271 {
 	/* RX Data filter rule status - enabled/disabled */
 	bool rx_data_filters_status[WL1271_MAX_RX_DATA_FILTERS];
 
+	/* runtime RX filter rules, indexed by FW data filter slot */
+	struct wlcore_rx_filter_rule
+		rx_filter_rules[WL1271_MAX_RX_DATA_FILTERS];
+
+	/* the runtime rules are programmed and FW data filtering is on */
+	bool rx_filters_active;
+
 	/* Timer to fire when Tx is stuck */
 	struct timer_list tx_stuck_timer;
 
@@ -142,7 +142,14 @@ struct wl_fw_packet_counters {
 	/* Cumulative counter of released Voice memory blocks */
 	u8 tx_voice_released_blks;
 
-	u8 padding[3];
+	/*
+	 * Rate (HW rate index) of the last frame transmitted on link
+	 * @hlid, and the same rate in Mbps. FW versions without this
+	 * report leave the bytes zeroed.
+	 */
+	u8 tx_last_rate;
+	u8 tx_last_rate_mbps;
+	u8 hlid;
 } __packed;
 
 /* FW status registers */
@@ -189,6 +196,16 @@ struct wl_fw_status_2 {
 } __packed;
 
 #define WL1271_MAX_CHANNELS 64
+#define WLCORE_SCAN_SEEN_MAX 64
+
+/* a beacon or probe response already handed up during the current scan */
+struct wlcore_scan_seen {
+	u8 bssid[ETH_ALEN];
+	u8 channel;
+	__le16 stype;
+	u32 crc;
+};
+
 struct wl1271_scan {
 	struct cfg80211_scan_request *req;
 	unsigned long scanned_ch[BITS_TO_LONGS(WL1271_MAX_CHANNELS)];
@@ -196,6 +213,17 @@ struct wl1271_scan {
 	u8 state;
 	u8 ssid[IEEE80211_MAX_SSID_LEN+1];
 	size_t ssid_len;
+
+	/* per-band scan commands, reused by all passes of a scan request */
+	struct wl1271_cmd_scan *cmd[IEEE80211_NUM_BANDS];
+	unsigned long cmd_ready;
+	struct wl1271_cmd_trigger_scan_to *trigger;
+	bool trigger_sent;
+
+	/* scan results seen so far, to drop unchanged copies */
+	struct wlcore_scan_seen seen[WLCORE_SCAN_SEEN_MAX];
+	int n_seen;
+	u32 dup_dropped;
 };
 
 struct wl1271_if_operations {
@@ -254,6 +282,8 @@ enum wl12xx_vif_flags {
 	WLVIF_FLAG_IN_USE,
 };
 
+#define WLCORE_NUM_TIDS 8
+
 struct wl1271_link {
 	/* AP-mode - TX queue per AC in link */
 	struct sk_buff_head tx_queue[NUM_TX_QUEUES];
@@ -266,6 +296,28 @@ struct wl1271_link {
 
 	/* bitmap of TIDs where RX BA sessions are active for this link */
 	u8 ba_bitmap;
+
+	/* last TX rate reported by the FW (HW rate index), 0 Mbps if none */
+	u8 fw_rate_idx;
+	u8 fw_rate_mbps;
+
+	/* RX traffic per TID, used by the RX BA session manager */
+	struct {
+		/* bytes received in the current period */
+		u32 bytes[WLCORE_NUM_TIDS];
+
+		/* moving average of the bytes received per period */
+		u32 load[WLCORE_NUM_TIDS];
+
+		/* load when the BA session was set up */
+		u32 start_load[WLCORE_NUM_TIDS];
+
+		/* consecutive periods without traffic */
+		u8 idle[WLCORE_NUM_TIDS];
+
+		/* TIDs whose ADDBA was refused for lack of FW sessions */
+		u8 wanted;
+	} rx_ba;
 };
 
 #define WL1271_MAX_RX_DATA_FILTERS 4
@@ -301,6 +353,38 @@ struct wl12xx_rx_data_filter {
 	struct wl12xx_rx_data_filter_field fields[0];
 } __packed;
 
+/*
+ * Runtime RX filter rules, installed from debugfs and compiled into the FW
+ * data filter slots (one rule per slot) while a STA role is associated.
+ * The pattern is matched against the 802.3 view of the frame, like a
+ * WoWLAN pattern. COUNT rules stay in the host and only count matches, to
+ * measure what a DROP rule would save before installing it.
+ */
+enum wlcore_rx_filter_rule_action {
+	WLCORE_RX_FILTER_RULE_DROP,
+	WLCORE_RX_FILTER_RULE_PASS,
+	WLCORE_RX_FILTER_RULE_COUNT,
+};
+
+struct wlcore_rx_filter_rule {
+	bool in_use;
+	u8 action;
+	u8 len;
+	u8 pattern[WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE];
+
+	/*
+	 * one bit per pattern byte, set if the byte must match; same layout
+	 * as a cfg80211 WoWLAN pattern mask
+	 */
+	u8 mask[DIV_ROUND_UP(WL1271_RX_DATA_FILTER_MAX_PATTERN_SIZE, 8)];
+
+	/* the rule is currently programmed in the FW */
+	bool in_fw;
+
+	/* matching frames that still reached the host */
+	u32 host_hits;
+};
+
 struct wl1271_station {
 	u8 hlid;
 };
@@ -376,6 +460,15 @@ struct wl12xx_vif {
 	/* Beaconing interval (needed for ad-hoc) */
 	u32 beacon_int;
 
+	/*
+	 * mac80211 generation, crc (sans TIM) and rate of the last beacon
+	 * template pushed to the fw
+	 */
+	u32 beacon_tmpl_gen;
+	u32 beacon_tmpl_crc;
+	u32 beacon_tmpl_rate;
+	bool beacon_tmpl_valid;
+
 	/* Default key (for WEP) */
 	u32 default_key;
 
@@ -459,6 +552,48 @@ int wl1271_plt_stop(struct wl1271 *wl);
 int wl1271_recalc_rx_streaming(struct wl1271 *wl, struct wl12xx_vif *wlvif);
 void wl12xx_queue_recovery_work(struct wl1271 *wl);
 size_t wl12xx_copy_fwlog(struct wl1271 *wl, u8 *memblock, size_t maxlen);
+void wlcore_ba_mgr_rx(struct wl1271 *wl, u8 hlid, u8 tid, u32 len);
+
+/*
+ * FW log ring buffer, exported through the fwlog sysfs file. The header
+ * lives in the first page, the consumer's tail in the second one and the
+ * log data in the pages that follow. The header and the data can only be
+ * mmap()ed read-only, the tail page can be mapped on its own for writing.
+ * A consumer reads the data between @tail and @head and advances @tail.
+ * Both indices are free running and are used modulo @size. The driver
+ * never overwrites unconsumed data, log data that doesn't fit is dropped
+ * and accounted for instead.
+ *
+ * The header is only a copy of the driver's own state, which is all the
+ * driver relies on. The tail is clamped before it is used.
+ */
+struct wlcore_fwlog_ring {
+	__u32 size;		/* size of the data area, a power of 2 */
+	__u32 head;
+	__u32 flags;		/* WLCORE_FWLOG_RING_* */
+	__u32 dropped_bytes;
+	__u32 dropped_records;
+} __packed;
+
+struct wlcore_fwlog_tail {
+	__u32 tail;		/* written by the consumer only */
+} __packed;
+
+/* every chunk of log data is preceded by a struct wlcore_fwlog_rec */
+#define WLCORE_FWLOG_RING_TIMESTAMPS	BIT(0)
+
+struct wlcore_fwlog_rec {
+	__u32 len;		/* length of the log data that follows */
+	__u32 reserved;
+	__u64 timestamp;	/* local clock, ns */
+} __packed;
+
+#define WLCORE_FWLOG_RING_PAGES		16
+#define WLCORE_FWLOG_RING_SIZE		(PAGE_SIZE * WLCORE_FWLOG_RING_PAGES)
+
+/* page offsets of the tail and of the data within the mapping */
+#define WLCORE_FWLOG_TAIL_PGOFF		1
+#define WLCORE_FWLOG_DATA_PGOFF		2
 
 #define JOIN_TIMEOUT 5000 /* 5000 milliseconds to join */
 
@@ -16,9 +16,11 @@
 #include <linux/mod_devicetable.h>
 
 #include <linux/mmc/pm.h>
+#include <linux/mmc/host.h>
 
 struct mmc_card;
 struct sdio_func;
+struct scatterlist;
 
 typedef void (sdio_irq_handler_t)(struct sdio_func *);
 
@@ -153,6 +155,33 @@ extern int sdio_memcpy_toio(struct sdio_func *func, unsigned int addr,
 extern int sdio_writesb(struct sdio_func *func, unsigned int addr,
 	void *src, int count);
 
+/*
+ * Asynchronous IO_RW_EXTENDED request, see sdio_start_sg_req().
+ */
+struct sdio_sg_req {
+	struct scatterlist	*sg;		/* data buffer segments */
+	unsigned int		sg_len;
+	unsigned int		addr;		/* function address */
+	unsigned int		size;		/* total bytes to transfer */
+	bool			write;
+	bool			incr_addr;	/* false for a FIFO */
+
+	/* called once the request finished, with its status */
+	void			(*complete)(struct sdio_sg_req *req, int err);
+	void			*context;
+
+	/* private to the SDIO core */
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_data		data;
+	struct mmc_async_req	areq;
+};
+
+extern unsigned int sdio_sg_req_size(struct sdio_func *func,
+	unsigned int size, unsigned int max_segs);
+extern int sdio_start_sg_req(struct sdio_func *func, struct sdio_sg_req *req);
+extern int sdio_wait_sg_req(struct sdio_func *func);
+
 extern unsigned char sdio_f0_readb(struct sdio_func *func,
 	unsigned int addr, int *err_ret);
 extern void sdio_f0_writeb(struct sdio_func *func, unsigned char b,
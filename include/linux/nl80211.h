@@ -1254,6 +1254,11 @@ enum nl80211_commands {
  * @NL80211_ATTR_ROAMING_DISABLED: indicates that the driver can't do roaming
  *      currently.
  *
+ * @NL80211_ATTR_STA_STATS_ONLY: flag attribute for %NL80211_CMD_GET_STATION
+ *	dumps; only report the traffic counters, signal and inactive time of
+ *	each station (no rates, BSS parameters, flags or IEs). Meant for
+ *	periodic polling of large BSSes.
+ *
  * @NL80211_ATTR_MAX: highest attribute number currently defined
  * @__NL80211_ATTR_AFTER_LAST: internal use
  */
@@ -1513,6 +1518,8 @@ enum nl80211_attrs {
 
 	NL80211_ATTR_ROAMING_DISABLED,
 
+	NL80211_ATTR_STA_STATS_ONLY,
+
 	/* add attributes here, update the policy in nl80211.c */
 
 	__NL80211_ATTR_AFTER_LAST,
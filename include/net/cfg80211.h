@@ -2512,7 +2512,8 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
  *
  * Decode an IEEE 802.11n A-MSDU frame and convert it to a list of
  * 802.3 frames. The @list will be empty if the decode fails. The
- * @skb is consumed after the function returns.
+ * @skb is consumed after the function returns. Subframes may be
+ * clones sharing the data of @skb rather than copies of it.
  *
  * @skb: The input IEEE 802.11n A-MSDU frame.
  * @list: The output list of 802.3 frames. It must be allocated and
@@ -2729,6 +2729,20 @@ static inline struct sk_buff *ieee80211_beacon_get(struct ieee80211_hw *hw,
 	return ieee80211_beacon_get_tim(hw, vif, NULL, NULL);
 }
 
+/**
+ * ieee80211_beacon_get_gen - beacon template generation
+ * @vif: &struct ieee80211_vif pointer from the add_interface callback.
+ *
+ * Returns a counter that changes whenever the beacon or probe response
+ * template of @vif (everything except the TIM IE) may have changed, so
+ * that drivers which upload templates to the device can skip calling
+ * ieee80211_beacon_get_tim() and ieee80211_proberesp_get() when handling
+ * a %BSS_CHANGED_BEACON notification for a template they already pushed.
+ * A value of 0 means the generation is not tracked for this interface
+ * type and the template must always be fetched again.
+ */
+u32 ieee80211_beacon_get_gen(struct ieee80211_vif *vif);
+
 /**
  * ieee80211_proberesp_get - retrieve a Probe Response template
  * @hw: pointer obtained from ieee80211_alloc_hw().
@@ -2904,6 +2918,11 @@ ieee80211_get_buffered_bc(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
  *
  * This function sets netdev feature bit for the device associated with the
  * specified vif.
+ *
+ * If segmentation offload (e.g. %NETIF_F_TSO) is enabled, mac80211 builds
+ * the 802.11 header once for the whole GSO frame and segments it right
+ * before the tx handlers run, so the driver still only receives linear
+ * frames, each with its own copy of the headers and tx info.
  */
 void ieee80211_set_netdev_features(struct ieee80211_vif *vif, int features);
 
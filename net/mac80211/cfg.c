@@ -519,6 +519,7 @@ static int ieee80211_set_probe_resp(struct ieee80211_sub_if_data *sdata,
 	memcpy(skb_put(new, resp_len), resp, resp_len);
 
 	rcu_assign_pointer(sdata->u.ap.probe_resp, new);
+	sdata->beacon_gen++;
 	synchronize_rcu();
 
 	if (old)
@@ -616,6 +617,7 @@ static int ieee80211_config_beacon(struct ieee80211_sub_if_data *sdata,
 	sdata->vif.bss_conf.dtim_period = new->dtim_period;
 
 	RCU_INIT_POINTER(sdata->u.ap.beacon, new);
+	sdata->beacon_gen++;
 
 	synchronize_rcu();
 
@@ -209,6 +209,7 @@ static void __ieee80211_sta_join_ibss(struct ieee80211_sub_if_data *sdata,
 	}
 
 	RCU_INIT_POINTER(ifibss->presp, skb);
+	sdata->beacon_gen++;
 
 	sdata->vif.bss_conf.beacon_int = beacon_int;
 	sdata->vif.bss_conf.basic_rates = basic_rates;
@@ -241,6 +241,13 @@ struct ieee80211_if_ap {
 	 * bitmap_empty :)
 	 * NB: don't touch this bitmap, use sta_info_{set,clear}_tim_bit */
 	u8 tim[sizeof(unsigned long) * BITS_TO_LONGS(IEEE80211_MAX_AID + 1)];
+	/*
+	 * Number of AIDs set in @tim and the first/last non-zero byte of
+	 * it, maintained incrementally under local->tim_lock so the beacon
+	 * can copy out the partial virtual bitmap without scanning @tim.
+	 */
+	u16 tim_aids;
+	u8 tim_first, tim_last;
 	struct sk_buff_head ps_bc_buf;
 	atomic_t num_sta_ps; /* number of stations in PS mode */
 	atomic_t num_sta_authorized; /* number of authorized stations */
@@ -517,6 +524,16 @@ struct ieee80211_if_mesh {
 	/* Last used PREQ ID */
 	u32 preq_id;
 	atomic_t mpaths;
+	/* Mesh paths and mesh portal paths (MPP) of this interface */
+	struct mesh_table __rcu *mesh_paths;
+	struct mesh_table __rcu *mpp_paths;
+	/* Taken as writer to grow the path tables, as reader to add / del */
+	rwlock_t pathtbl_resize_lock;
+	/* Protects the next hop path lists, see &struct mesh_path */
+	spinlock_t nexthop_lock;
+	/* Per-CPU next hop cache, flushed by bumping nexthop_cache_seq */
+	struct mesh_nexthop_cache __percpu *nexthop_cache;
+	atomic_t nexthop_cache_seq;
 	/* Timestamp of last SN update */
 	unsigned long last_sn_update;
 	/* Time when it's ok to send next PERR */
@@ -621,6 +638,18 @@ struct ieee80211_sub_if_data {
 	/* TID bitmap for NoAck policy */
 	u16 noack_map;
 
+	/* bumped whenever a new beacon/probe response template is set */
+	u32 beacon_gen;
+
+	/*
+	 * Last station handed out by sta_info_get_by_idx(), so that station
+	 * dumps (serialised by RTNL) resume from there rather than walking
+	 * the list from the start again. Only valid while sta_generation
+	 * is unchanged.
+	 */
+	int dump_sta_idx, dump_sta_gen;
+	u8 dump_sta_addr[ETH_ALEN];
+
 	struct ieee80211_key __rcu *keys[NUM_DEFAULT_KEYS + NUM_DEFAULT_MGMT_KEYS];
 	struct ieee80211_key __rcu *default_unicast_key;
 	struct ieee80211_key __rcu *default_multicast_key;
@@ -863,7 +892,6 @@ struct ieee80211_local {
 	unsigned long num_sta;
 	struct list_head sta_list;
 	struct sta_info __rcu *sta_hash[STA_HASH_SIZE];
-	struct timer_list sta_cleanup;
 	int sta_generation;
 
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
@@ -1365,6 +1393,8 @@ void ieee802_11_parse_elems(u8 *start, size_t len,
 u32 ieee802_11_parse_elems_crc(u8 *start, size_t len,
 			       struct ieee802_11_elems *elems,
 			       u64 filter, u32 crc);
+u32 ieee802_11_elems_crc(u8 *start, size_t len, u64 filter, u32 crc,
+			 struct ieee80211_tim_ie **tim, u8 *tim_len);
 u32 ieee80211_mandatory_rates(struct ieee80211_local *local,
 			      enum ieee80211_band band);
 
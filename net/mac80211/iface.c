@@ -647,6 +647,9 @@ static void ieee80211_teardown_sdata(struct net_device *dev)
 
 	flushed = sta_info_flush(local, sdata);
 	WARN_ON(flushed);
+
+	if (ieee80211_vif_is_mesh(&sdata->vif))
+		mesh_pathtbl_unregister(sdata);
 }
 
 static u16 ieee80211_netdev_select_queue(struct net_device *dev,
@@ -838,10 +841,14 @@ static void ieee80211_iface_work(struct work_struct *work)
 
 /*
  * Helper function to initialise an interface to a specific type.
+ * Only a mesh interface can fail to set up, nothing needs to be torn
+ * down in that case.
  */
-static void ieee80211_setup_sdata(struct ieee80211_sub_if_data *sdata,
-				  enum nl80211_iftype type)
+static int ieee80211_setup_sdata(struct ieee80211_sub_if_data *sdata,
+				 enum nl80211_iftype type)
 {
+	int ret;
+
 	/* clear type-dependent union */
 	memset(&sdata->u, 0, sizeof(sdata->u));
 
@@ -884,8 +891,11 @@ static void ieee80211_setup_sdata(struct ieee80211_sub_if_data *sdata,
 		ieee80211_ibss_setup_sdata(sdata);
 		break;
 	case NL80211_IFTYPE_MESH_POINT:
-		if (ieee80211_vif_is_mesh(&sdata->vif))
-			ieee80211_mesh_init_sdata(sdata);
+		if (ieee80211_vif_is_mesh(&sdata->vif)) {
+			ret = ieee80211_mesh_init_sdata(sdata);
+			if (ret)
+				return ret;
+		}
 		break;
 	case NL80211_IFTYPE_MONITOR:
 		sdata->dev->type = ARPHRD_IEEE80211_RADIOTAP;
@@ -903,6 +913,8 @@ static void ieee80211_setup_sdata(struct ieee80211_sub_if_data *sdata,
 	}
 
 	ieee80211_debugfs_add_netdev(sdata);
+
+	return 0;
 }
 
 static int ieee80211_runtime_change_iftype(struct ieee80211_sub_if_data *sdata,
@@ -968,7 +980,9 @@ static int ieee80211_runtime_change_iftype(struct ieee80211_sub_if_data *sdata,
 	if (ret)
 		type = sdata->vif.type;
 
-	ieee80211_setup_sdata(sdata, type);
+	/* none of the types allowed above can fail to set up */
+	err = ieee80211_setup_sdata(sdata, type);
+	WARN_ON(err);
 
 	err = ieee80211_do_open(sdata->dev, false);
 	WARN(err, "type change: do_open returned %d", err);
@@ -979,11 +993,12 @@ static int ieee80211_runtime_change_iftype(struct ieee80211_sub_if_data *sdata,
 int ieee80211_if_change_type(struct ieee80211_sub_if_data *sdata,
 			     enum nl80211_iftype type)
 {
+	enum nl80211_iftype old_type = ieee80211_vif_type_p2p(&sdata->vif);
 	int ret;
 
 	ASSERT_RTNL();
 
-	if (type == ieee80211_vif_type_p2p(&sdata->vif))
+	if (type == old_type)
 		return 0;
 
 	/* Setting ad-hoc mode on non-IBSS channel is not supported. */
@@ -998,7 +1013,12 @@ int ieee80211_if_change_type(struct ieee80211_sub_if_data *sdata,
 	} else {
 		/* Purge and reset type-dependent state. */
 		ieee80211_teardown_sdata(sdata->dev);
-		ieee80211_setup_sdata(sdata, type);
+		ret = ieee80211_setup_sdata(sdata, type);
+		if (ret) {
+			/* the old type was not mesh, so it can't fail */
+			WARN_ON(ieee80211_setup_sdata(sdata, old_type));
+			return ret;
+		}
 	}
 
 	/* reset some values that shouldn't be kept across type changes */
@@ -1184,7 +1204,9 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	}
 
 	/* setup type-dependent data */
-	ieee80211_setup_sdata(sdata, type);
+	ret = ieee80211_setup_sdata(sdata, type);
+	if (ret)
+		goto fail;
 
 	if (params) {
 		ndev->ieee80211_ptr->use_4addr = params->use_4addr;
@@ -33,6 +33,8 @@
  * @MESH_PATH_RESOLVED: the mesh path can has been resolved
  * @MESH_PATH_REQ_QUEUED: there is an unsent path request for this destination
  * already queued up, waiting for the discovery process to start.
+ * @MESH_PATH_DELETED: the mesh path has been removed from the path table and
+ * is only waiting for RCU to free it.
  *
  * MESH_PATH_RESOLVED is used by the mesh path timer to
  * decide when to stop or cancel the mesh path discovery.
@@ -44,6 +46,7 @@ enum mesh_path_flags {
 	MESH_PATH_FIXED	=	BIT(3),
 	MESH_PATH_RESOLVED =	BIT(4),
 	MESH_PATH_REQ_QUEUED =	BIT(5),
+	MESH_PATH_DELETED =	BIT(6),
 };
 
 /**
@@ -87,12 +90,14 @@ enum mesh_deferred_task_flags {
  * mpath itself.  No need to take this lock when adding or removing
  * an mpath to a hash bucket on a path table.
  * @is_gate: the destination station of this path is a mesh gate
+ * @nexthop_list: entry in the next hop's &sta_info.mesh_paths list, protected
+ * by the interface's nexthop_lock
  *
  *
- * The combination of dst and sdata is unique in the mesh path table. Since the
- * next_hop STA is only protected by RCU as well, deleting the STA must also
- * remove/substitute the mesh_path structure and wait until that is no longer
- * reachable before destroying the STA completely.
+ * Each mesh interface has its own path table and dst is unique within it.
+ * Since the next_hop STA is only protected by RCU as well, deleting the STA
+ * must also remove/substitute the mesh_path structure and wait until that is
+ * no longer reachable before destroying the STA completely.
  */
 struct mesh_path {
 	u8 dst[ETH_ALEN];
@@ -111,6 +116,7 @@ struct mesh_path {
 	enum mesh_path_flags flags;
 	spinlock_t state_lock;
 	bool is_gate;
+	struct list_head nexthop_list;
 };
 
 /**
@@ -149,6 +155,35 @@ struct mesh_table {
 	struct rcu_head rcu_head;
 };
 
+/* Next hop cache, MESH_NEXTHOP_CACHE_SIZE must be a power of 2 */
+#define MESH_NEXTHOP_CACHE_SIZE	32
+
+/**
+ * struct mesh_nexthop_cache_entry - cached next hop of a mesh destination
+ *
+ * @dst: mesh path destination
+ * @next_hop: address of the next hop towards @dst
+ * @valid_until: in jiffies, when the path is due for a refresh
+ * @seq: &ieee80211_if_mesh.nexthop_cache_seq at the time the entry was filled,
+ *	the entry is stale once the two differ
+ */
+struct mesh_nexthop_cache_entry {
+	u8 dst[ETH_ALEN];
+	u8 next_hop[ETH_ALEN];
+	unsigned long valid_until;
+	int seq;
+};
+
+/**
+ * struct mesh_nexthop_cache - per-CPU direct mapped next hop cache
+ *
+ * Lets mesh_nexthop_lookup() skip the path table lookup for recently used
+ * destinations. Only accessed with BH disabled.
+ */
+struct mesh_nexthop_cache {
+	struct mesh_nexthop_cache_entry entries[MESH_NEXTHOP_CACHE_SIZE];
+};
+
 /* Recent multicast cache */
 /* RMC_BUCKETS must be a power of 2, maximum 256 */
 #define RMC_BUCKETS		256
@@ -225,7 +260,7 @@ void ieee80211s_init(void);
 void ieee80211s_update_metric(struct ieee80211_local *local,
 		struct sta_info *stainfo, struct sk_buff *skb);
 void ieee80211s_stop(void);
-void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata);
+int ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata);
 void ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata);
 void ieee80211_stop_mesh(struct ieee80211_sub_if_data *sdata);
 void ieee80211_mesh_root_setup(struct ieee80211_if_mesh *ifmsh);
@@ -268,16 +303,16 @@ void mesh_rx_plink_frame(struct ieee80211_sub_if_data *sdata,
 
 /* Private interfaces */
 /* Mesh tables */
-void mesh_mpath_table_grow(void);
-void mesh_mpp_table_grow(void);
+void mesh_mpath_table_grow(struct ieee80211_sub_if_data *sdata);
+void mesh_mpp_table_grow(struct ieee80211_sub_if_data *sdata);
 /* Mesh paths */
 int mesh_path_error_tx(u8 ttl, u8 *target, __le32 target_sn, __le16 target_rcode,
 		       const u8 *ra, struct ieee80211_sub_if_data *sdata);
 void mesh_path_assign_nexthop(struct mesh_path *mpath, struct sta_info *sta);
 void mesh_path_flush_pending(struct mesh_path *mpath);
 void mesh_path_tx_pending(struct mesh_path *mpath);
-int mesh_pathtbl_init(void);
-void mesh_pathtbl_unregister(void);
+int mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata);
+void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata);
 int mesh_path_del(u8 *addr, struct ieee80211_sub_if_data *sdata);
 void mesh_path_timer(unsigned long data);
 void mesh_path_flush_by_nexthop(struct sta_info *sta);
@@ -311,6 +346,16 @@ static inline void mesh_path_activate(struct mesh_path *mpath)
 	mpath->flags |= MESH_PATH_ACTIVE | MESH_PATH_RESOLVED;
 }
 
+/*
+ * Invalidate all cached next hops of the interface, needed whenever a path
+ * loses its next hop or switches to a different one.
+ */
+static inline void mesh_nexthop_cache_flush(struct ieee80211_sub_if_data *sdata)
+{
+	smp_mb__before_atomic_inc();
+	atomic_inc(&sdata->u.mesh.nexthop_cache_seq);
+}
+
 static inline bool mesh_path_sel_is_hwmp(struct ieee80211_sub_if_data *sdata)
 {
 	return sdata->u.mesh.mesh_pp_id == IEEE80211_PATH_PROTOCOL_HWMP;
@@ -702,6 +702,7 @@ static void hwmp_perr_frame_process(struct ieee80211_sub_if_data *sdata,
 			mpath->flags &= ~MESH_PATH_ACTIVE;
 			mpath->sn = target_sn;
 			spin_unlock_bh(&mpath->state_lock);
+			mesh_nexthop_cache_flush(sdata);
 			mesh_path_error_tx(ttl, target_addr, cpu_to_le32(target_sn),
 					   cpu_to_le16(target_rcode),
 					   broadcast_addr, sdata);
@@ -1035,6 +1036,17 @@ endlookup:
 	rcu_read_unlock();
 	return err;
 }
+
+static struct mesh_nexthop_cache_entry *
+mesh_nexthop_cache_entry(struct ieee80211_sub_if_data *sdata, const u8 *dst)
+{
+	struct mesh_nexthop_cache *cache;
+
+	cache = this_cpu_ptr(sdata->u.mesh.nexthop_cache);
+	return &cache->entries[(dst[3] ^ dst[4] ^ dst[5]) &
+			       (MESH_NEXTHOP_CACHE_SIZE - 1)];
+}
+
 /**
  * mesh_nexthop_lookup - put the appropriate next hop on a mesh frame. Calling
  * this function is considered "using" the associated mpath, so preempt a path
@@ -1043,16 +1055,34 @@ endlookup:
  * @skb: 802.11 frame to be sent
  * @sdata: network subif the frame will be sent through
  *
+ * Destinations whose path is not due for a refresh are served from the
+ * per-CPU next hop cache without touching the path table.
+ *
  * Returns: 0 if the next hop was found. Nonzero otherwise.
+ *
+ * Locking: must be called with BH disabled.
  */
 int mesh_nexthop_lookup(struct sk_buff *skb,
 			struct ieee80211_sub_if_data *sdata)
 {
+	struct mesh_nexthop_cache_entry *cached;
 	struct mesh_path *mpath;
 	struct sta_info *next_hop;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	u8 *target_addr = hdr->addr3;
+	unsigned long refresh, valid_until;
 	int err = -ENOENT;
+	int seq;
+
+	seq = atomic_read(&sdata->u.mesh.nexthop_cache_seq);
+	smp_rmb();
+	cached = mesh_nexthop_cache_entry(sdata, target_addr);
+	if (cached->seq == seq && time_before(jiffies, cached->valid_until) &&
+	    compare_ether_addr(cached->dst, target_addr) == 0) {
+		memcpy(hdr->addr1, cached->next_hop, ETH_ALEN);
+		memcpy(hdr->addr2, sdata->vif.addr, ETH_ALEN);
+		return 0;
+	}
 
 	rcu_read_lock();
 	mpath = mesh_path_lookup(target_addr, sdata);
@@ -1060,9 +1090,8 @@ int mesh_nexthop_lookup(struct sk_buff *skb,
 	if (!mpath || !(mpath->flags & MESH_PATH_ACTIVE))
 		goto endlookup;
 
-	if (time_after(jiffies,
-		       mpath->exp_time -
-		       msecs_to_jiffies(sdata->u.mesh.mshcfg.path_refresh_time)) &&
+	refresh = msecs_to_jiffies(sdata->u.mesh.mshcfg.path_refresh_time);
+	if (time_after(jiffies, mpath->exp_time - refresh) &&
 	    !memcmp(sdata->vif.addr, hdr->addr4, ETH_ALEN) &&
 	    !(mpath->flags & MESH_PATH_RESOLVING) &&
 	    !(mpath->flags & MESH_PATH_FIXED))
@@ -1073,6 +1102,18 @@ int mesh_nexthop_lookup(struct sk_buff *skb,
 		memcpy(hdr->addr1, next_hop->sta.addr, ETH_ALEN);
 		memcpy(hdr->addr2, sdata->vif.addr, ETH_ALEN);
 		err = 0;
+
+		/* fixed paths don't expire, recheck them now and then */
+		if (mpath->flags & MESH_PATH_FIXED)
+			valid_until = jiffies + refresh;
+		else
+			valid_until = mpath->exp_time - refresh;
+		if (time_before(jiffies, valid_until)) {
+			memcpy(cached->dst, target_addr, ETH_ALEN);
+			memcpy(cached->next_hop, next_hop->sta.addr, ETH_ALEN);
+			cached->valid_until = valid_until;
+			cached->seq = seq;
+		}
 	}
 
 endlookup:
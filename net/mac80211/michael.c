@@ -8,6 +8,7 @@
  */
 #include <linux/types.h>
 #include <linux/bitops.h>
+#include <linux/kernel.h>
 #include <linux/ieee80211.h>
 #include <asm/unaligned.h>
 
@@ -66,8 +67,21 @@ void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
 	blocks = data_len / 4;
 	left = data_len % 4;
 
-	for (block = 0; block < blocks; block++)
-		michael_block(&mctx, get_unaligned_le32(&data[block * 4]));
+	/*
+	 * The payload follows an 802.11 header plus IV, so it is frequently
+	 * 4-byte aligned; avoid the bytewise unaligned accessors on
+	 * architectures that lack efficient unaligned loads in that case.
+	 */
+	if (IS_ALIGNED((unsigned long)data, 4)) {
+		const __le32 *word = (const __le32 *)data;
+
+		for (block = 0; block < blocks; block++)
+			michael_block(&mctx, le32_to_cpu(word[block]));
+	} else {
+		for (block = 0; block < blocks; block++)
+			michael_block(&mctx,
+				      get_unaligned_le32(&data[block * 4]));
+	}
 
 	/* Partial block of 0..3 bytes and padding: 0x5a + 4..7 zeros to make
 	 * total length a multiple of 4. */
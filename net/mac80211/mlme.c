@@ -1814,6 +1814,8 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	u8 erp_value = 0;
 	u32 ncrc;
 	u8 *bssid;
+	struct ieee80211_tim_ie *tim;
+	u8 tim_len;
 
 	ASSERT_MGD_MTX(ifmgd);
 
@@ -1921,16 +1923,22 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	 */
 	ieee80211_sta_reset_beacon_monitor(sdata);
 
+	/*
+	 * Most beacons only differ from the previous one in the TIM, so
+	 * check the CRC of the elements we care about first and only do
+	 * the full parse when one of them changed.
+	 */
 	ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
-	ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
-					  len - baselen, &elems,
-					  care_about_ies, ncrc);
+	ncrc = ieee802_11_elems_crc(mgmt->u.beacon.variable, len - baselen,
+				    care_about_ies, ncrc, &tim, &tim_len);
 
 	if (local->hw.flags & IEEE80211_HW_PS_NULLFUNC_STACK)
-		directed_tim = ieee80211_check_tim(elems.tim, elems.tim_len,
-						   ifmgd->aid);
+		directed_tim = ieee80211_check_tim(tim, tim_len, ifmgd->aid);
 
 	if (ncrc != ifmgd->beacon_crc || !ifmgd->beacon_crc_valid) {
+		ieee802_11_parse_elems(mgmt->u.beacon.variable,
+				       len - baselen, &elems);
+
 		ieee80211_rx_bss_info(sdata, mgmt, len, rx_status, &elems,
 				      true);
 
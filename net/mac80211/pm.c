@@ -63,7 +63,10 @@ int __ieee80211_suspend(struct ieee80211_hw *hw, struct cfg80211_wowlan *wowlan)
 	flush_workqueue(local->workqueue);
 
 	/* Don't try to run timers while suspended. */
-	del_timer_sync(&local->sta_cleanup);
+	mutex_lock(&local->sta_mtx);
+	list_for_each_entry(sta, &local->sta_list, list)
+		del_timer_sync(&sta->ps_expire_timer);
+	mutex_unlock(&local->sta_mtx);
 
 	 /*
 	 * Note that this particular timer doesn't need to be
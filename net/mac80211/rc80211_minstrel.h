@@ -79,6 +79,14 @@ struct minstrel_priv {
 	unsigned int lookaround_rate;
 	unsigned int lookaround_rate_mrr;
 
+	/*
+	 * minstrel_ht: stations whose statistics are due for an update,
+	 * processed by update_work outside of the tx status path
+	 */
+	spinlock_t update_lock;
+	struct list_head update_list;
+	struct work_struct update_work;
+
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/*
 	 * enable fixed rate processing per RC
@@ -132,23 +132,32 @@ minstrel_get_ratestats(struct minstrel_ht_sta *mi, int index)
 static void
 minstrel_calc_rate_ewma(struct minstrel_rate_stats *mr)
 {
-	if (unlikely(mr->attempts > 0)) {
+	unsigned int success, attempts;
+
+	/*
+	 * tx_status keeps adding to the counters while they are collected,
+	 * a status landing between the two exchanges is counted as a
+	 * success without its attempts.
+	 */
+	success = atomic_xchg(&mr->success, 0);
+	attempts = atomic_xchg(&mr->attempts, 0);
+	success = min(success, attempts);
+
+	if (unlikely(attempts > 0)) {
 		mr->sample_skipped = 0;
-		mr->cur_prob = MINSTREL_FRAC(mr->success, mr->attempts);
+		mr->cur_prob = MINSTREL_FRAC(success, attempts);
 		if (!mr->att_hist)
 			mr->probability = mr->cur_prob;
 		else
 			mr->probability = minstrel_ewma(mr->probability,
 				mr->cur_prob, EWMA_LEVEL);
-		mr->att_hist += mr->attempts;
-		mr->succ_hist += mr->success;
+		mr->att_hist += attempts;
+		mr->succ_hist += success;
 	} else {
 		mr->sample_skipped++;
 	}
-	mr->last_success = mr->success;
-	mr->last_attempts = mr->attempts;
-	mr->success = 0;
-	mr->attempts = 0;
+	mr->last_success = success;
+	mr->last_attempts = attempts;
 }
 
 /*
@@ -173,6 +182,29 @@ minstrel_ht_calc_tp(struct minstrel_ht_sta *mi, int group, int rate)
 	mr->cur_tp = MINSTREL_TRUNC((1000000 / usecs) * mr->probability);
 }
 
+/*
+ * Publish a new set of primary rates for get_rate. If no memory is
+ * available the previous rates stay in use until the next update.
+ */
+static void
+minstrel_ht_set_rates(struct minstrel_ht_sta_priv *msp,
+		      const struct minstrel_ht_rates *rates)
+{
+	struct minstrel_ht_rates *new, *old;
+
+	new = kmemdup(rates, sizeof(*new), GFP_ATOMIC);
+	if (!new)
+		return;
+
+	spin_lock_bh(&msp->rates_lock);
+	old = rcu_dereference_protected(msp->rates,
+					lockdep_is_held(&msp->rates_lock));
+	rcu_assign_pointer(msp->rates, new);
+	spin_unlock_bh(&msp->rates_lock);
+
+	kfree_rcu(old, rcu_head);
+}
+
 /*
  * Update rate statistics and select new primary rates
  *
@@ -183,25 +215,39 @@ minstrel_ht_calc_tp(struct minstrel_ht_sta *mi, int group, int rate)
  *    higher throughput rates, even if the probablity is a bit lower
  */
 static void
-minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
+minstrel_ht_update_stats(struct minstrel_priv *mp,
+			 struct minstrel_ht_sta_priv *msp)
 {
+	struct minstrel_ht_sta *mi = &msp->ht;
 	struct minstrel_mcs_group_data *mg;
 	struct minstrel_rate_stats *mr;
+	struct minstrel_ht_rates rates = {};
+	unsigned int max_tp, max_tp2, max_prob;
 	int cur_prob, cur_prob_tp, cur_tp, cur_tp2;
 	int group, i, index;
-
-	if (mi->ampdu_packets > 0) {
+	unsigned int ampdu_len, ampdu_packets;
+	bool ampdu_changed;
+
+	ampdu_packets = atomic_xchg(&mi->ampdu_packets, 0);
+	ampdu_len = atomic_xchg(&mi->ampdu_len, 0);
+	if (ampdu_packets > 0) {
+		/* every status accounts for at least one frame */
+		ampdu_len = max(ampdu_len, ampdu_packets);
 		mi->avg_ampdu_len = minstrel_ewma(mi->avg_ampdu_len,
-			MINSTREL_FRAC(mi->ampdu_len, mi->ampdu_packets), EWMA_LEVEL);
-		mi->ampdu_len = 0;
-		mi->ampdu_packets = 0;
+			MINSTREL_FRAC(ampdu_len, ampdu_packets), EWMA_LEVEL);
 	}
 
+	/*
+	 * Throughput and retry counts of a rate only depend on its delivery
+	 * probability and the truncated A-MPDU length. Rates without status
+	 * in this or the previous interval keep them unless the latter moved.
+	 */
+	ampdu_len = MINSTREL_TRUNC(mi->avg_ampdu_len);
+	ampdu_changed = ampdu_len != mi->stats_ampdu_len;
+	mi->stats_ampdu_len = ampdu_len;
+
 	mi->sample_slow = 0;
 	mi->sample_count = 0;
-	mi->max_tp_rate = 0;
-	mi->max_tp_rate2 = 0;
-	mi->max_prob_rate = 0;
 
 	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++) {
 		cur_prob = 0;
@@ -213,9 +259,13 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		if (!mg->supported)
 			continue;
 
-		mg->max_tp_rate = 0;
-		mg->max_tp_rate2 = 0;
-		mg->max_prob_rate = 0;
+		/*
+		 * tx_status reads the group maxima for downgrades, only
+		 * store them once they are complete
+		 */
+		max_tp = 0;
+		max_tp2 = 0;
+		max_prob = 0;
 		mi->sample_count++;
 
 		for (i = 0; i < MCS_GROUP_RATES; i++) {
@@ -223,10 +273,15 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 				continue;
 
 			mr = &mg->rates[i];
-			mr->retry_updated = false;
 			index = MCS_GROUP_RATES * group + i;
-			minstrel_calc_rate_ewma(mr);
-			minstrel_ht_calc_tp(mi, group, i);
+			if (atomic_read(&mr->attempts) || mr->last_attempts ||
+			    ampdu_changed) {
+				mr->retry_updated = false;
+				minstrel_calc_rate_ewma(mr);
+				minstrel_ht_calc_tp(mi, group, i);
+			} else {
+				mr->sample_skipped++;
+			}
 
 			if (!mr->cur_tp)
 				continue;
@@ -237,25 +292,29 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 
 			if ((mr->cur_tp > cur_prob_tp && mr->probability >
 			     MINSTREL_FRAC(3, 4)) || mr->probability > cur_prob) {
-				mg->max_prob_rate = index;
+				max_prob = index;
 				cur_prob = mr->probability;
 				cur_prob_tp = mr->cur_tp;
 			}
 
 			if (mr->cur_tp > cur_tp) {
-				swap(index, mg->max_tp_rate);
+				swap(index, max_tp);
 				cur_tp = mr->cur_tp;
 				mr = minstrel_get_ratestats(mi, index);
 			}
 
-			if (index >= mg->max_tp_rate)
+			if (index >= max_tp)
 				continue;
 
 			if (mr->cur_tp > cur_tp2) {
-				mg->max_tp_rate2 = index;
+				max_tp2 = index;
 				cur_tp2 = mr->cur_tp;
 			}
 		}
+
+		mg->max_tp_rate = max_tp;
+		mg->max_tp_rate2 = max_tp2;
+		mg->max_prob_rate = max_prob;
 	}
 
 	/* try to sample up to half of the available rates during each interval */
@@ -273,26 +332,28 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		mr = minstrel_get_ratestats(mi, mg->max_prob_rate);
 		if (cur_prob_tp < mr->cur_tp &&
 		    minstrel_mcs_groups[group].streams == 1) {
-			mi->max_prob_rate = mg->max_prob_rate;
+			rates.max_prob_rate = mg->max_prob_rate;
 			cur_prob = mr->cur_prob;
 			cur_prob_tp = mr->cur_tp;
 		}
 
 		mr = minstrel_get_ratestats(mi, mg->max_tp_rate);
 		if (cur_tp < mr->cur_tp) {
-			mi->max_tp_rate2 = mi->max_tp_rate;
+			rates.max_tp_rate2 = rates.max_tp_rate;
 			cur_tp2 = cur_tp;
-			mi->max_tp_rate = mg->max_tp_rate;
+			rates.max_tp_rate = mg->max_tp_rate;
 			cur_tp = mr->cur_tp;
 		}
 
 		mr = minstrel_get_ratestats(mi, mg->max_tp_rate2);
 		if (cur_tp2 < mr->cur_tp) {
-			mi->max_tp_rate2 = mg->max_tp_rate2;
+			rates.max_tp_rate2 = mg->max_tp_rate2;
 			cur_tp2 = mr->cur_tp;
 		}
 	}
 
+	minstrel_ht_set_rates(msp, &rates);
+
 	mi->stats_update = jiffies;
 }
 
@@ -355,6 +416,57 @@ minstrel_downgrade_rate(struct minstrel_ht_sta *mi, unsigned int *idx,
 	}
 }
 
+/*
+ * Replace a primary throughput rate that stopped working with the best
+ * rate of a group with fewer streams, starting from the current rates.
+ */
+static void
+minstrel_ht_downgrade(struct minstrel_ht_sta_priv *msp, bool primary)
+{
+	struct minstrel_ht_rates *new, *old;
+	unsigned int idx;
+
+	spin_lock_bh(&msp->rates_lock);
+	old = rcu_dereference_protected(msp->rates,
+					lockdep_is_held(&msp->rates_lock));
+
+	/* only replace the table if a lower stream group is usable */
+	idx = primary ? old->max_tp_rate : old->max_tp_rate2;
+	minstrel_downgrade_rate(&msp->ht, &idx, primary);
+	if (idx == (primary ? old->max_tp_rate : old->max_tp_rate2))
+		goto out;
+
+	new = kmemdup(old, sizeof(*new), GFP_ATOMIC);
+	if (!new)
+		goto out;
+
+	if (primary)
+		new->max_tp_rate = idx;
+	else
+		new->max_tp_rate2 = idx;
+
+	rcu_assign_pointer(msp->rates, new);
+	spin_unlock_bh(&msp->rates_lock);
+
+	kfree_rcu(old, rcu_head);
+	return;
+
+out:
+	spin_unlock_bh(&msp->rates_lock);
+}
+
+/* check for sudden death of a primary rate since the last update */
+static bool
+minstrel_ht_rate_failing(struct minstrel_ht_sta *mi, unsigned int index)
+{
+	struct minstrel_rate_stats *mr = minstrel_get_ratestats(mi, index);
+	unsigned int attempts = atomic_read(&mr->attempts);
+
+	return attempts > 30 &&
+	       MINSTREL_FRAC(atomic_read(&mr->success), attempts) <
+	       MINSTREL_FRAC(20, 100);
+}
+
 static void
 minstrel_aggr_check(struct ieee80211_sta *pubsta, struct sk_buff *skb)
 {
@@ -378,6 +490,65 @@ minstrel_aggr_check(struct ieee80211_sta *pubsta, struct sk_buff *skb)
 	ieee80211_start_tx_ba_session(pubsta, tid, 5000);
 }
 
+/*
+ * Schedule a statistics update for this station. Returns true if the
+ * station was not already waiting for one.
+ */
+static bool
+minstrel_ht_queue_update(struct minstrel_priv *mp,
+			 struct minstrel_ht_sta_priv *msp)
+{
+	bool queued = false;
+
+	if (!list_empty(&msp->update_list))
+		return false;
+
+	spin_lock_bh(&mp->update_lock);
+	if (list_empty(&msp->update_list)) {
+		list_add_tail(&msp->update_list, &mp->update_list);
+		queued = true;
+	}
+	spin_unlock_bh(&mp->update_lock);
+
+	if (queued)
+		schedule_work(&mp->update_work);
+
+	return queued;
+}
+
+static void
+minstrel_ht_update_work(struct work_struct *work)
+{
+	struct minstrel_priv *mp =
+		container_of(work, struct minstrel_priv, update_work);
+	struct minstrel_ht_sta_priv *msp;
+
+	/*
+	 * Take one station at a time off the list and update it with only
+	 * its own stats_lock held, so tx_status can keep queueing updates
+	 * meanwhile. The stats_lock is taken before the list lock is
+	 * dropped, so free_sta can't free the station under us.
+	 */
+	for (;;) {
+		spin_lock_bh(&mp->update_lock);
+		if (list_empty(&mp->update_list)) {
+			spin_unlock_bh(&mp->update_lock);
+			break;
+		}
+		msp = list_first_entry(&mp->update_list,
+				       struct minstrel_ht_sta_priv,
+				       update_list);
+		list_del_init(&msp->update_list);
+		spin_lock(&msp->stats_lock);
+		spin_unlock(&mp->update_lock);
+
+		if (msp->is_ht)
+			minstrel_ht_update_stats(mp, msp);
+
+		spin_unlock_bh(&msp->stats_lock);
+	}
+}
+
 static void
 minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
                       struct ieee80211_sta *sta, void *priv_sta,
@@ -387,7 +558,8 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	struct minstrel_ht_sta *mi = &msp->ht;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_tx_rate *ar = info->status.rates;
-	struct minstrel_rate_stats *rate, *rate2;
+	struct minstrel_rate_stats *rate;
+	struct minstrel_ht_rates *rates;
 	struct minstrel_priv *mp = priv;
 	bool last = false;
 	int group;
@@ -407,8 +579,8 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 		info->status.ampdu_len = 1;
 	}
 
-	mi->ampdu_packets++;
-	mi->ampdu_len += info->status.ampdu_len;
+	atomic_inc(&mi->ampdu_packets);
+	atomic_add(info->status.ampdu_len, &mi->ampdu_len);
 
 	if (!mi->sample_wait && !mi->sample_tries && mi->sample_count > 0) {
 		mi->sample_wait = 16 + 2 * MINSTREL_TRUNC(mi->avg_ampdu_len);
@@ -430,32 +602,34 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 		rate = &mi->groups[group].rates[ar[i].idx % 8];
 
 		if (last)
-			rate->success += info->status.ampdu_ack_len;
+			atomic_add(info->status.ampdu_ack_len, &rate->success);
 
-		rate->attempts += ar[i].count * info->status.ampdu_len;
+		atomic_add(ar[i].count * info->status.ampdu_len,
+			   &rate->attempts);
 	}
 
 	/*
 	 * check for sudden death of spatial multiplexing,
 	 * downgrade to a lower number of streams if necessary.
 	 */
-	rate = minstrel_get_ratestats(mi, mi->max_tp_rate);
-	if (rate->attempts > 30 &&
-	    MINSTREL_FRAC(rate->success, rate->attempts) <
-	    MINSTREL_FRAC(20, 100))
-		minstrel_downgrade_rate(mi, &mi->max_tp_rate, true);
-
-	rate2 = minstrel_get_ratestats(mi, mi->max_tp_rate2);
-	if (rate2->attempts > 30 &&
-	    MINSTREL_FRAC(rate2->success, rate2->attempts) <
-	    MINSTREL_FRAC(20, 100))
-		minstrel_downgrade_rate(mi, &mi->max_tp_rate2, false);
-
-	if (time_after(jiffies, mi->stats_update + (mp->update_interval / 2 * HZ) / 1000)) {
-		minstrel_ht_update_stats(mp, mi);
-		if (!(info->flags & IEEE80211_TX_CTL_AMPDU))
-			minstrel_aggr_check(sta, skb);
-	}
+	rcu_read_lock();
+	rates = rcu_dereference(msp->rates);
+	if (minstrel_ht_rate_failing(mi, rates->max_tp_rate))
+		minstrel_ht_downgrade(msp, true);
+
+	rates = rcu_dereference(msp->rates);
+	if (minstrel_ht_rate_failing(mi, rates->max_tp_rate2))
+		minstrel_ht_downgrade(msp, false);
+	rcu_read_unlock();
+
+	/*
+	 * Recalculating the statistics walks every rate of every group,
+	 * leave that to the update worker instead of doing it here.
+	 */
+	if (time_after(jiffies, mi->stats_update + (mp->update_interval / 2 * HZ) / 1000) &&
+	    minstrel_ht_queue_update(mp, msp) &&
+	    !(info->flags & IEEE80211_TX_CTL_AMPDU))
+		minstrel_aggr_check(sta, skb);
 }
 
 static void
@@ -546,7 +720,8 @@ minstrel_get_duration(int index)
 }
 
 static int
-minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
+minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
+			 const struct minstrel_ht_rates *rates)
 {
 	struct minstrel_rate_stats *mr;
 	struct minstrel_mcs_group_data *mg;
@@ -579,7 +754,7 @@ minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	 * if the link is working perfectly.
 	 */
 	if (minstrel_get_duration(sample_idx) >
-	    minstrel_get_duration(mi->max_tp_rate)) {
+	    minstrel_get_duration(rates->max_tp_rate)) {
 		if (mr->sample_skipped < 20)
 			return -1;
 
@@ -598,6 +773,7 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	struct ieee80211_tx_rate *ar = info->status.rates;
 	struct minstrel_ht_sta_priv *msp = priv_sta;
 	struct minstrel_ht_sta *mi = &msp->ht;
+	struct minstrel_ht_rates *rates;
 	struct minstrel_priv *mp = priv;
 	int sample_idx;
 	bool sample = false;
@@ -610,12 +786,15 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 
 	info->flags |= mi->tx_flags;
 
+	rcu_read_lock();
+	rates = rcu_dereference(msp->rates);
+
 	/* Don't use EAPOL frames for sampling on non-mrr hw */
 	if (mp->hw->max_rates == 1 &&
 	    txrc->skb->protocol == cpu_to_be16(ETH_P_PAE))
 		sample_idx = -1;
 	else
-		sample_idx = minstrel_get_sample_rate(mp, mi);
+		sample_idx = minstrel_get_sample_rate(mp, mi, rates);
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/* use fixed index if set */
@@ -629,7 +808,7 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 			true, false);
 		info->flags |= IEEE80211_TX_CTL_RATE_CTRL_PROBE;
 	} else {
-		minstrel_ht_set_rate(mp, mi, &ar[0], mi->max_tp_rate,
+		minstrel_ht_set_rate(mp, mi, &ar[0], rates->max_tp_rate,
 			false, false);
 	}
 
@@ -640,13 +819,13 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		 * max_tp_rate -> max_tp_rate2 -> max_prob_rate by default.
 		 */
 		if (sample_idx >= 0)
-			minstrel_ht_set_rate(mp, mi, &ar[1], mi->max_tp_rate,
+			minstrel_ht_set_rate(mp, mi, &ar[1], rates->max_tp_rate,
 				false, false);
 		else
-			minstrel_ht_set_rate(mp, mi, &ar[1], mi->max_tp_rate2,
-				false, true);
+			minstrel_ht_set_rate(mp, mi, &ar[1],
+				rates->max_tp_rate2, false, true);
 
-		minstrel_ht_set_rate(mp, mi, &ar[2], mi->max_prob_rate,
+		minstrel_ht_set_rate(mp, mi, &ar[2], rates->max_prob_rate,
 				     false, !sample);
 
 		ar[3].count = 0;
@@ -657,7 +836,7 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		 * sample_rate -> max_prob_rate for sampling and
 		 * max_tp_rate -> max_prob_rate by default.
 		 */
-		minstrel_ht_set_rate(mp, mi, &ar[1], mi->max_prob_rate,
+		minstrel_ht_set_rate(mp, mi, &ar[1], rates->max_prob_rate,
 				     false, !sample);
 
 		ar[2].count = 0;
@@ -667,6 +846,7 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		ar[1].count = 0;
 		ar[1].idx = -1;
 	}
+	rcu_read_unlock();
 
 	mi->total_packets++;
 
@@ -687,6 +867,7 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	struct minstrel_ht_sta *mi = &msp->ht;
 	struct ieee80211_mcs_info *mcs = &sta->ht_cap.mcs;
 	struct ieee80211_local *local = hw_to_local(mp->hw);
+	struct minstrel_ht_rates rates = {};
 	u16 sta_cap = sta->ht_cap.cap;
 	int n_supported = 0;
 	int ack_dur;
@@ -758,6 +939,7 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	if (!n_supported)
 		goto use_legacy;
 
+	minstrel_ht_set_rates(msp, &rates);
 	return;
 
 use_legacy:
@@ -768,13 +950,34 @@ use_legacy:
 	return mac80211_minstrel.rate_init(priv, sband, sta, &msp->legacy);
 }
 
+/*
+ * Reinitialize the station with the update worker kept out, and drop
+ * any statistics update queued for the old state.
+ */
+static void
+minstrel_ht_reinit_caps(void *priv, struct ieee80211_supported_band *sband,
+			struct ieee80211_sta *sta, void *priv_sta,
+			enum nl80211_channel_type oper_chan_type)
+{
+	struct minstrel_priv *mp = priv;
+	struct minstrel_ht_sta_priv *msp = priv_sta;
+
+	spin_lock_bh(&mp->update_lock);
+	list_del_init(&msp->update_list);
+	spin_unlock_bh(&mp->update_lock);
+
+	spin_lock_bh(&msp->stats_lock);
+	minstrel_ht_update_caps(priv, sband, sta, priv_sta, oper_chan_type);
+	spin_unlock_bh(&msp->stats_lock);
+}
+
 static void
 minstrel_ht_rate_init(void *priv, struct ieee80211_supported_band *sband,
                       struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_priv *mp = priv;
 
-	minstrel_ht_update_caps(priv, sband, sta, priv_sta, mp->hw->conf.channel_type);
+	minstrel_ht_reinit_caps(priv, sband, sta, priv_sta, mp->hw->conf.channel_type);
 }
 
 static void
@@ -782,7 +985,7 @@ minstrel_ht_rate_update(void *priv, struct ieee80211_supported_band *sband,
                         struct ieee80211_sta *sta, void *priv_sta,
                         u32 changed, enum nl80211_channel_type oper_chan_type)
 {
-	minstrel_ht_update_caps(priv, sband, sta, priv_sta, oper_chan_type);
+	minstrel_ht_reinit_caps(priv, sband, sta, priv_sta, oper_chan_type);
 }
 
 static void *
@@ -801,10 +1004,14 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 			max_rates = sband->n_bitrates;
 	}
 
-	msp = kzalloc(sizeof(struct minstrel_ht_sta), gfp);
+	msp = kzalloc(sizeof(*msp), gfp);
 	if (!msp)
 		return NULL;
 
+	INIT_LIST_HEAD(&msp->update_list);
+	spin_lock_init(&msp->stats_lock);
+	spin_lock_init(&msp->rates_lock);
+
 	msp->ratelist = kzalloc(sizeof(struct minstrel_rate) * max_rates, gfp);
 	if (!msp->ratelist)
 		goto error;
@@ -813,8 +1020,15 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	if (!msp->sample_table)
 		goto error1;
 
+	RCU_INIT_POINTER(msp->rates,
+			 kzalloc(sizeof(struct minstrel_ht_rates), gfp));
+	if (!rcu_access_pointer(msp->rates))
+		goto error2;
+
 	return msp;
 
+error2:
+	kfree(msp->sample_table);
 error1:
 	kfree(msp->ratelist);
 error:
@@ -825,8 +1039,18 @@ error:
 static void
 minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
+	struct minstrel_priv *mp = priv;
 	struct minstrel_ht_sta_priv *msp = priv_sta;
 
+	spin_lock_bh(&mp->update_lock);
+	list_del(&msp->update_list);
+	spin_unlock_bh(&mp->update_lock);
+
+	/* wait for an update of this station that is still running */
+	spin_lock_bh(&msp->stats_lock);
+	spin_unlock_bh(&msp->stats_lock);
+
+	kfree(rcu_dereference_protected(msp->rates, true));
 	kfree(msp->sample_table);
 	kfree(msp->ratelist);
 	kfree(msp);
@@ -835,12 +1059,25 @@ minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 static void *
 minstrel_ht_alloc(struct ieee80211_hw *hw, struct dentry *debugfsdir)
 {
-	return mac80211_minstrel.alloc(hw, debugfsdir);
+	struct minstrel_priv *mp;
+
+	mp = mac80211_minstrel.alloc(hw, debugfsdir);
+	if (!mp)
+		return NULL;
+
+	spin_lock_init(&mp->update_lock);
+	INIT_LIST_HEAD(&mp->update_list);
+	INIT_WORK(&mp->update_work, minstrel_ht_update_work);
+
+	return mp;
 }
 
 static void
 minstrel_ht_free(void *priv)
 {
+	struct minstrel_priv *mp = priv;
+
+	cancel_work_sync(&mp->update_work);
 	mac80211_minstrel.free(priv);
 }
 
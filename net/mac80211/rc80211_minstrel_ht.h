@@ -32,9 +32,14 @@ struct mcs_group {
 extern const struct mcs_group minstrel_mcs_groups[];
 
 struct minstrel_rate_stats {
-	/* current / last sampling period attempts/success counters */
-	unsigned int attempts, last_attempts;
-	unsigned int success, last_success;
+	/*
+	 * current sampling period attempts/success counters, added to from
+	 * tx_status and collected by the statistics update
+	 */
+	atomic_t attempts, success;
+
+	/* last sampling period attempts/success counters */
+	unsigned int last_attempts, last_success;
 
 	/* total attempts/success counters */
 	u64 att_hist, succ_hist;
@@ -69,13 +74,12 @@ struct minstrel_mcs_group_data {
 	struct minstrel_rate_stats rates[MCS_GROUP_RATES];
 };
 
-struct minstrel_ht_sta {
-	/* ampdu length (average, per sampling interval) */
-	unsigned int ampdu_len;
-	unsigned int ampdu_packets;
-
-	/* ampdu length (EWMA) */
-	unsigned int avg_ampdu_len;
+/*
+ * Primary rates, rebuilt by the statistics update (or a downgrade from
+ * tx_status) and published to get_rate through RCU
+ */
+struct minstrel_ht_rates {
+	struct rcu_head rcu_head;
 
 	/* best throughput rate */
 	unsigned int max_tp_rate;
@@ -85,6 +89,18 @@ struct minstrel_ht_sta {
 
 	/* best probability rate */
 	unsigned int max_prob_rate;
+};
+
+struct minstrel_ht_sta {
+	/* ampdu length (average, per sampling interval) */
+	atomic_t ampdu_len;
+	atomic_t ampdu_packets;
+
+	/* ampdu length (EWMA) */
+	unsigned int avg_ampdu_len;
+
+	/* truncated avg_ampdu_len used for the current throughput values */
+	unsigned int stats_ampdu_len;
 
 	/* time of last status update */
 	unsigned long stats_update;
@@ -122,6 +138,16 @@ struct minstrel_ht_sta_priv {
 	void *ratelist;
 	void *sample_table;
 	bool is_ht;
+
+	/* entry in minstrel_priv->update_list while an update is pending */
+	struct list_head update_list;
+
+	/* keeps reinit and free out while the statistics are updated */
+	spinlock_t stats_lock;
+
+	/* current primary rates, replaced under rates_lock */
+	struct minstrel_ht_rates __rcu *rates;
+	spinlock_t rates_lock;
 };
 
 void minstrel_ht_add_sta_debugfs(void *priv, void *priv_sta, struct dentry *dir);
@@ -20,6 +20,7 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 {
 	struct minstrel_ht_sta_priv *msp = inode->i_private;
 	struct minstrel_ht_sta *mi = &msp->ht;
+	struct minstrel_ht_rates *rates;
 	struct minstrel_debugfs_info *ms;
 	unsigned int i, j, tp, prob, eprob;
 	char *p;
@@ -38,6 +39,9 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 
 	file->private_data = ms;
 	p = ms->buf;
+
+	rcu_read_lock();
+	rates = rcu_dereference(msp->rates);
 	p += sprintf(p, "type      rate     throughput  ewma prob   this prob  "
 			"this succ/attempt   success    attempts\n");
 	for (i = 0; i < MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS; i++) {
@@ -61,9 +65,9 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 
 			p += sprintf(p, "HT%c0/%cGI ", htmode, gimode);
 
-			*(p++) = (idx == mi->max_tp_rate) ? 'T' : ' ';
-			*(p++) = (idx == mi->max_tp_rate2) ? 't' : ' ';
-			*(p++) = (idx == mi->max_prob_rate) ? 'P' : ' ';
+			*(p++) = (idx == rates->max_tp_rate) ? 'T' : ' ';
+			*(p++) = (idx == rates->max_tp_rate2) ? 't' : ' ';
+			*(p++) = (idx == rates->max_prob_rate) ? 'P' : ' ';
 			p += sprintf(p, "MCS%-2u", (minstrel_mcs_groups[i].streams - 1) *
 					MCS_GROUP_RATES + j);
 
@@ -82,6 +86,8 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 					(unsigned long long)mr->att_hist);
 		}
 	}
+	rcu_read_unlock();
+
 	p += sprintf(p, "\nTotal packet count::    ideal %d      "
 			"lookaround %d\n",
 			max(0, (int) mi->total_packets - (int) mi->sample_packets),
@@ -552,23 +552,24 @@ static inline u16 seq_sub(u16 sq1, u16 sq2)
 
 static void ieee80211_release_reorder_frame(struct ieee80211_hw *hw,
 					    struct tid_ampdu_rx *tid_agg_rx,
-					    int index)
+					    int index,
+					    struct sk_buff_head *frames)
 {
-	struct ieee80211_local *local = hw_to_local(hw);
-	struct sk_buff *skb = tid_agg_rx->reorder_buf[index];
+	struct sk_buff *skb;
 	struct ieee80211_rx_status *status;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
-	if (!skb)
+	if (!test_and_clear_bit(index, tid_agg_rx->reorder_filled))
 		goto no_frame;
 
 	/* release the frame from the reorder ring buffer */
+	skb = tid_agg_rx->reorder_buf[index].skb;
 	tid_agg_rx->stored_mpdu_num--;
-	tid_agg_rx->reorder_buf[index] = NULL;
+	tid_agg_rx->reorder_buf[index].skb = NULL;
 	status = IEEE80211_SKB_RXCB(skb);
 	status->rx_flags |= IEEE80211_RX_DEFERRED_RELEASE;
-	skb_queue_tail(&local->rx_skb_queue, skb);
+	__skb_queue_tail(frames, skb);
 
 no_frame:
 	tid_agg_rx->head_seq_num = seq_inc(tid_agg_rx->head_seq_num);
@@ -576,19 +577,72 @@ no_frame:
 
 static void ieee80211_release_reorder_frames(struct ieee80211_hw *hw,
 					     struct tid_ampdu_rx *tid_agg_rx,
-					     u16 head_seq_num)
+					     u16 head_seq_num,
+					     struct sk_buff_head *frames)
 {
 	int index;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
+	/* nothing stored, just move the window */
+	if (!tid_agg_rx->stored_mpdu_num) {
+		if (seq_less(tid_agg_rx->head_seq_num, head_seq_num))
+			tid_agg_rx->head_seq_num = head_seq_num;
+		return;
+	}
+
 	while (seq_less(tid_agg_rx->head_seq_num, head_seq_num)) {
 		index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
 							tid_agg_rx->buf_size;
-		ieee80211_release_reorder_frame(hw, tid_agg_rx, index);
+		ieee80211_release_reorder_frame(hw, tid_agg_rx, index, frames);
 	}
 }
 
+/*
+ * Find the next reorder buffer slot holding a frame, starting at
+ * @index and wrapping around the ring. Returns -1 if the buffer
+ * is empty.
+ */
+static int ieee80211_reorder_next_slot(struct tid_ampdu_rx *tid_agg_rx,
+				       int index)
+{
+	int j;
+
+	j = find_next_bit(tid_agg_rx->reorder_filled,
+			  tid_agg_rx->buf_size, index);
+	if (j < tid_agg_rx->buf_size)
+		return j;
+
+	j = find_first_bit(tid_agg_rx->reorder_filled, index);
+	if (j < index)
+		return j;
+
+	return -1;
+}
+
+/*
+ * Hand a burst of frames released from the reorder buffer to the
+ * RX handlers, taking the queue lock only once. This must happen
+ * under tid_agg_rx->reorder_lock, as before the burst release, so
+ * that the data, BAR and reorder timeout paths can't reorder their
+ * bursts against each other.
+ */
+static void ieee80211_rx_queue_frames(struct ieee80211_local *local,
+				      struct tid_ampdu_rx *tid_agg_rx,
+				      struct sk_buff_head *frames)
+{
+	unsigned long flags;
+
+	lockdep_assert_held(&tid_agg_rx->reorder_lock);
+
+	if (skb_queue_empty(frames))
+		return;
+
+	spin_lock_irqsave(&local->rx_skb_queue.lock, flags);
+	skb_queue_splice_tail_init(frames, &local->rx_skb_queue);
+	spin_unlock_irqrestore(&local->rx_skb_queue.lock, flags);
+}
+
 /*
  * Timeout (in jiffies) for skb's that are waiting in the RX reorder buffer. If
  * the skb was added to the buffer longer than this time ago, the earlier
@@ -601,30 +655,38 @@ static void ieee80211_release_reorder_frames(struct ieee80211_hw *hw,
 #define HT_RX_REORDER_BUF_TIMEOUT (HZ / 10)
 
 static void ieee80211_sta_reorder_release(struct ieee80211_hw *hw,
-					  struct tid_ampdu_rx *tid_agg_rx)
+					  struct tid_ampdu_rx *tid_agg_rx,
+					  struct sk_buff_head *frames)
 {
-	int index, j;
+	int index, j, prev;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	/* release the buffer until next missing frame */
 	index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
 						tid_agg_rx->buf_size;
-	if (!tid_agg_rx->reorder_buf[index] &&
+	if (!test_bit(index, tid_agg_rx->reorder_filled) &&
 	    tid_agg_rx->stored_mpdu_num > 1) {
 		/*
 		 * No buffers ready to be released, but check whether any
 		 * frames in the reorder buffer have timed out.
 		 */
 		int skipped = 1;
-		for (j = (index + 1) % tid_agg_rx->buf_size; j != index;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (!tid_agg_rx->reorder_buf[j]) {
-				skipped++;
-				continue;
-			}
+
+		prev = index;
+		for (j = ieee80211_reorder_next_slot(tid_agg_rx,
+				(index + 1) % tid_agg_rx->buf_size);
+		     j >= 0 && j != index;
+		     j = ieee80211_reorder_next_slot(tid_agg_rx,
+				(j + 1) % tid_agg_rx->buf_size)) {
+			/* account for the empty slots we jumped over */
+			skipped += (j - prev - 1 + tid_agg_rx->buf_size) %
+							tid_agg_rx->buf_size;
+			prev = j;
+
 			if (skipped &&
-			    !time_after(jiffies, tid_agg_rx->reorder_time[j] +
+			    !time_after(jiffies,
+					tid_agg_rx->reorder_buf[j].time +
 					HT_RX_REORDER_BUF_TIMEOUT))
 				goto set_release_timer;
 
@@ -633,7 +695,8 @@ static void ieee80211_sta_reorder_release(struct ieee80211_hw *hw,
 				wiphy_debug(hw->wiphy,
 					    "release an RX reorder frame due to timeout on earlier frames\n");
 #endif
-			ieee80211_release_reorder_frame(hw, tid_agg_rx, j);
+			ieee80211_release_reorder_frame(hw, tid_agg_rx, j,
+							frames);
 
 			/*
 			 * Increment the head seq# also for the skipped slots.
@@ -642,26 +705,23 @@ static void ieee80211_sta_reorder_release(struct ieee80211_hw *hw,
 				(tid_agg_rx->head_seq_num + skipped) & SEQ_MASK;
 			skipped = 0;
 		}
-	} else while (tid_agg_rx->reorder_buf[index]) {
-		ieee80211_release_reorder_frame(hw, tid_agg_rx, index);
+	} else while (test_bit(index, tid_agg_rx->reorder_filled)) {
+		ieee80211_release_reorder_frame(hw, tid_agg_rx, index, frames);
 		index =	seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
 							tid_agg_rx->buf_size;
 	}
 
 	if (tid_agg_rx->stored_mpdu_num) {
-		j = index = seq_sub(tid_agg_rx->head_seq_num,
-				    tid_agg_rx->ssn) % tid_agg_rx->buf_size;
-
-		for (; j != (index - 1) % tid_agg_rx->buf_size;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (tid_agg_rx->reorder_buf[j])
-				break;
-		}
+		index = seq_sub(tid_agg_rx->head_seq_num,
+				tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+		j = ieee80211_reorder_next_slot(tid_agg_rx, index);
+		if (WARN_ON(j < 0))
+			return;
 
  set_release_timer:
 
 		mod_timer(&tid_agg_rx->reorder_timer,
-			  tid_agg_rx->reorder_time[j] + 1 +
+			  tid_agg_rx->reorder_buf[j].time + 1 +
 			  HT_RX_REORDER_BUF_TIMEOUT);
 	} else {
 		del_timer(&tid_agg_rx->reorder_timer);
@@ -681,9 +741,12 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_hw *hw,
 	u16 sc = le16_to_cpu(hdr->seq_ctrl);
 	u16 mpdu_seq_num = (sc & IEEE80211_SCTL_SEQ) >> 4;
 	u16 head_seq_num, buf_size;
+	struct sk_buff_head frames;
 	int index;
 	bool ret = true;
 
+	__skb_queue_head_init(&frames);
+
 	spin_lock(&tid_agg_rx->reorder_lock);
 
 	buf_size = tid_agg_rx->buf_size;
@@ -702,7 +765,8 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_hw *hw,
 	if (!seq_less(mpdu_seq_num, head_seq_num + buf_size)) {
 		head_seq_num = seq_inc(seq_sub(mpdu_seq_num, buf_size));
 		/* release stored frames up to new head to stack */
-		ieee80211_release_reorder_frames(hw, tid_agg_rx, head_seq_num);
+		ieee80211_release_reorder_frames(hw, tid_agg_rx, head_seq_num,
+						 &frames);
 	}
 
 	/* Now the new frame is always in the range of the reordering buffer */
@@ -710,7 +774,7 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_hw *hw,
 	index = seq_sub(mpdu_seq_num, tid_agg_rx->ssn) % tid_agg_rx->buf_size;
 
 	/* check if we already stored this frame */
-	if (tid_agg_rx->reorder_buf[index]) {
+	if (test_bit(index, tid_agg_rx->reorder_filled)) {
 		dev_kfree_skb(skb);
 		goto out;
 	}
@@ -729,12 +793,14 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_hw *hw,
 	}
 
 	/* put the frame in the reordering buffer */
-	tid_agg_rx->reorder_buf[index] = skb;
-	tid_agg_rx->reorder_time[index] = jiffies;
+	tid_agg_rx->reorder_buf[index].skb = skb;
+	tid_agg_rx->reorder_buf[index].time = jiffies;
+	set_bit(index, tid_agg_rx->reorder_filled);
 	tid_agg_rx->stored_mpdu_num++;
-	ieee80211_sta_reorder_release(hw, tid_agg_rx);
+	ieee80211_sta_reorder_release(hw, tid_agg_rx, &frames);
 
  out:
+	ieee80211_rx_queue_frames(hw_to_local(hw), tid_agg_rx, &frames);
 	spin_unlock(&tid_agg_rx->reorder_lock);
 	return ret;
 }
@@ -2089,6 +2155,7 @@ ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
 		struct {
 			__le16 control, start_seq_num;
 		} __packed bar_data;
+		struct sk_buff_head frames;
 
 		if (!rx->sta)
 			return RX_DROP_MONITOR;
@@ -2110,9 +2177,13 @@ ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
 			mod_timer(&tid_agg_rx->session_timer,
 				  TU_TO_EXP_TIME(tid_agg_rx->timeout));
 
+		__skb_queue_head_init(&frames);
+
 		spin_lock(&tid_agg_rx->reorder_lock);
 		/* release stored frames up to start of BAR */
-		ieee80211_release_reorder_frames(hw, tid_agg_rx, start_seq_num);
+		ieee80211_release_reorder_frames(hw, tid_agg_rx, start_seq_num,
+						 &frames);
+		ieee80211_rx_queue_frames(rx->local, tid_agg_rx, &frames);
 		spin_unlock(&tid_agg_rx->reorder_lock);
 
 		kfree_skb(skb);
@@ -2776,13 +2847,17 @@ void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid)
 		.flags = 0,
 	};
 	struct tid_ampdu_rx *tid_agg_rx;
+	struct sk_buff_head frames;
 
 	tid_agg_rx = rcu_dereference(sta->ampdu_mlme.tid_rx[tid]);
 	if (!tid_agg_rx)
 		return;
 
+	__skb_queue_head_init(&frames);
+
 	spin_lock(&tid_agg_rx->reorder_lock);
-	ieee80211_sta_reorder_release(&sta->local->hw, tid_agg_rx);
+	ieee80211_sta_reorder_release(&sta->local->hw, tid_agg_rx, &frames);
+	ieee80211_rx_queue_frames(sta->local, tid_agg_rx, &frames);
 	spin_unlock(&tid_agg_rx->reorder_lock);
 
 	ieee80211_rx_handlers(&rx);
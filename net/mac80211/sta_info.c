@@ -179,9 +179,30 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 				     int idx)
 {
 	struct ieee80211_local *local = sdata->local;
-	struct sta_info *sta;
+	struct sta_info *sta = NULL;
+	int gen = local->sta_generation;
 	int i = 0;
 
+	smp_rmb();
+
+	/*
+	 * Dumps ask for the same index again (when the message filled up)
+	 * or for the next one; continue from the cached station then.
+	 */
+	if (sdata->dump_sta_gen == gen &&
+	    (idx == sdata->dump_sta_idx || idx == sdata->dump_sta_idx + 1))
+		sta = sta_info_get(sdata, sdata->dump_sta_addr);
+
+	if (sta) {
+		if (idx == sdata->dump_sta_idx)
+			goto found;
+		list_for_each_entry_continue_rcu(sta, &local->sta_list, list) {
+			if (sdata == sta->sdata)
+				goto found;
+		}
+		return NULL;
+	}
+
 	list_for_each_entry_rcu(sta, &local->sta_list, list) {
 		if (sdata != sta->sdata)
 			continue;
@@ -189,10 +210,16 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 			++i;
 			continue;
 		}
-		return sta;
+		goto found;
 	}
 
 	return NULL;
+
+ found:
+	sdata->dump_sta_idx = idx;
+	sdata->dump_sta_gen = gen;
+	memcpy(sdata->dump_sta_addr, sta->sta.addr, ETH_ALEN);
+	return sta;
 }
 
 /**
@@ -273,6 +300,8 @@ static int sta_prepare_rate_control(struct ieee80211_local *local,
 	return 0;
 }
 
+static void sta_info_ps_expire(unsigned long data);
+
 struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 				const u8 *addr, gfp_t gfp)
 {
@@ -316,6 +345,8 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 		skb_queue_head_init(&sta->ps_tx_buf[i]);
 		skb_queue_head_init(&sta->tx_filtered[i]);
 	}
+	setup_timer(&sta->ps_expire_timer, sta_info_ps_expire,
+		    (unsigned long)sta);
 
 	for (i = 0; i < NUM_RX_DATA_QUEUES; i++)
 		sta->last_seq_ctrl[i] = cpu_to_le16(USHRT_MAX);
@@ -327,6 +358,7 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 #ifdef CONFIG_MAC80211_MESH
 	sta->plink_state = NL80211_PLINK_LISTEN;
 	init_timer(&sta->plink_timer);
+	INIT_LIST_HEAD(&sta->mesh_paths);
 #endif
 
 	return sta;
@@ -501,20 +533,55 @@ int sta_info_reinsert(struct sta_info *sta)
 
 static inline void __bss_tim_set(struct ieee80211_if_ap *bss, u16 aid)
 {
+	u8 idx = aid / 8;
+
+	if (bss->tim[idx] & (1 << (aid % 8)))
+		return;
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __set_bit() format.
 	 */
-	bss->tim[aid / 8] |= (1 << (aid % 8));
+	bss->tim[idx] |= (1 << (aid % 8));
+
+	if (bss->tim_aids++ == 0) {
+		bss->tim_first = bss->tim_last = idx;
+		return;
+	}
+
+	if (idx < bss->tim_first)
+		bss->tim_first = idx;
+	if (idx > bss->tim_last)
+		bss->tim_last = idx;
 }
 
 static inline void __bss_tim_clear(struct ieee80211_if_ap *bss, u16 aid)
 {
+	u8 idx = aid / 8;
+
+	if (!(bss->tim[idx] & (1 << (aid % 8))))
+		return;
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __clear_bit() format.
 	 */
-	bss->tim[aid / 8] &= ~(1 << (aid % 8));
+	bss->tim[idx] &= ~(1 << (aid % 8));
+
+	if (--bss->tim_aids == 0 || bss->tim[idx])
+		return;
+
+	/*
+	 * The byte became empty; if it was one of the bounds, move that
+	 * bound inwards. There is at least one other AID set, so both
+	 * scans stop within the old [tim_first, tim_last] range.
+	 */
+	if (idx == bss->tim_first)
+		while (!bss->tim[bss->tim_first])
+			bss->tim_first++;
+	if (idx == bss->tim_last)
+		while (!bss->tim[bss->tim_last])
+			bss->tim_last--;
 }
 
 static unsigned long ieee80211_tids_for_ac(int ac)
@@ -597,23 +664,184 @@ void sta_info_recalc_tim(struct sta_info *sta)
 	spin_unlock_irqrestore(&local->tim_lock, flags);
 }
 
+static unsigned long sta_info_buffer_timeout(struct sta_info *sta)
+{
+	unsigned long timeout;
+
+	/* Timeout: (2 * listen_interval * beacon_int * 1024 / 1000000) sec */
+	timeout = (sta->listen_interval *
+		   sta->sdata->vif.bss_conf.beacon_int *
+		   32 / 15625) * HZ;
+	if (timeout < STA_TX_BUFFER_EXPIRE)
+		timeout = STA_TX_BUFFER_EXPIRE;
+	return timeout;
+}
+
 static bool sta_info_buffer_expired(struct sta_info *sta, struct sk_buff *skb)
 {
 	struct ieee80211_tx_info *info;
-	int timeout;
 
 	if (!skb)
 		return false;
 
 	info = IEEE80211_SKB_CB(skb);
 
-	/* Timeout: (2 * listen_interval * beacon_int * 1024 / 1000000) sec */
-	timeout = (sta->listen_interval *
-		   sta->sdata->vif.bss_conf.beacon_int *
-		   32 / 15625) * HZ;
-	if (timeout < STA_TX_BUFFER_EXPIRE)
-		timeout = STA_TX_BUFFER_EXPIRE;
-	return time_after(jiffies, info->control.jiffies + timeout);
+	return time_after(jiffies,
+			  info->control.jiffies + sta_info_buffer_timeout(sta));
+}
+
+/**
+ * sta_ps_buf_enqueue - queue a frame for a station in power save
+ * @sta: the station
+ * @ac: access category of the frame
+ * @skb: the frame
+ *
+ * Call sta_ps_buf_make_room() first to keep the station within its budget.
+ */
+void sta_ps_buf_enqueue(struct sta_info *sta, int ac, struct sk_buff *skb)
+{
+	struct sk_buff_head *q = &sta->ps_tx_buf[ac];
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	__skb_queue_tail(q, skb);
+	sta->ps_buf_bytes[ac] += skb->len;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sta->local->total_ps_buffered++;
+}
+
+/**
+ * sta_ps_buf_dequeue - take the oldest PS-buffered frame off a station's queue
+ * @sta: the station
+ * @ac: access category to dequeue from
+ *
+ * Returns: the frame, or %NULL if nothing is buffered on @ac
+ */
+struct sk_buff *sta_ps_buf_dequeue(struct sta_info *sta, int ac)
+{
+	struct sk_buff_head *q = &sta->ps_tx_buf[ac];
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	skb = __skb_dequeue(q);
+	if (skb)
+		sta->ps_buf_bytes[ac] -= skb->len;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	if (skb)
+		sta->local->total_ps_buffered--;
+	return skb;
+}
+
+/*
+ * Move all PS-buffered frames of @ac to the tail of @list. The byte count
+ * is reset under the queue lock so it can't race with an enqueue.
+ */
+static void sta_ps_buf_splice(struct sta_info *sta, int ac,
+			      struct sk_buff_head *list)
+{
+	struct sk_buff_head *q = &sta->ps_tx_buf[ac];
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	skb_queue_splice_tail_init(q, list);
+	sta->ps_buf_bytes[ac] = 0;
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static unsigned int sta_ps_buf_bytes(struct sta_info *sta)
+{
+	unsigned int bytes = 0;
+	int ac;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		bytes += sta->ps_buf_bytes[ac];
+	return bytes;
+}
+
+unsigned int sta_ps_buf_frames(struct sta_info *sta)
+{
+	unsigned int frames = 0;
+	int ac;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		frames += skb_queue_len(&sta->ps_tx_buf[ac]);
+	return frames;
+}
+
+static void sta_ps_buf_drop(struct sta_info *sta, struct sk_buff *skb)
+{
+	sta->ps_buf_dropped++;
+	dev_kfree_skb(skb);
+}
+
+/**
+ * sta_ps_buf_drop_oldest - drop one PS-buffered frame of a station
+ * @sta: the station
+ *
+ * Drops the oldest frame of the lowest priority AC that has any.
+ *
+ * Returns: %true if a frame was dropped
+ */
+bool sta_ps_buf_drop_oldest(struct sta_info *sta)
+{
+	struct sk_buff *skb;
+	int ac;
+
+	for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO; ac--) {
+		skb = sta_ps_buf_dequeue(sta, ac);
+		if (skb) {
+			sta_ps_buf_drop(sta, skb);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * sta_ps_buf_make_room - make room for a frame within a station's budget
+ * @sta: the station
+ * @ac: access category the frame will be queued on
+ * @len: length of the frame
+ *
+ * Only the station's own oldest frames are dropped: first from @ac while
+ * that is over its frame or byte limit, then from the lowest priority ACs
+ * while the station as a whole is over its byte limit.
+ */
+void sta_ps_buf_make_room(struct sta_info *sta, int ac, unsigned int len)
+{
+	struct sk_buff *skb;
+
+	while (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER ||
+	       (sta->ps_buf_bytes[ac] &&
+		sta->ps_buf_bytes[ac] + len > STA_MAX_TX_BUFFER_AC_BYTES)) {
+		skb = sta_ps_buf_dequeue(sta, ac);
+		if (!skb)
+			break;
+		sta_ps_buf_drop(sta, skb);
+	}
+
+	while (sta_ps_buf_bytes(sta) + len > STA_MAX_TX_BUFFER_BYTES)
+		if (!sta_ps_buf_drop_oldest(sta))
+			break;
+}
+
+/**
+ * sta_info_ps_arm_expiry - arm the buffered frame expiry timer of a station
+ * @sta: the station
+ *
+ * Call after queueing a frame on @ps_tx_buf or @tx_filtered. If the timer is
+ * already pending it covers an older frame, so it is left alone.
+ */
+void sta_info_ps_arm_expiry(struct sta_info *sta)
+{
+	if (timer_pending(&sta->ps_expire_timer))
+		return;
+
+	mod_timer(&sta->ps_expire_timer,
+		  round_jiffies_up(jiffies + sta_info_buffer_timeout(sta)));
 }
 
 
@@ -647,6 +875,7 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 		 */
 		if (!skb)
 			break;
+		sta->ps_buf_expired++;
 		dev_kfree_skb(skb);
 	}
 
@@ -659,9 +888,10 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 	for (;;) {
 		spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
 		skb = skb_peek(&sta->ps_tx_buf[ac]);
-		if (sta_info_buffer_expired(sta, skb))
+		if (sta_info_buffer_expired(sta, skb)) {
 			skb = __skb_dequeue(&sta->ps_tx_buf[ac]);
-		else
+			sta->ps_buf_bytes[ac] -= skb->len;
+		} else
 			skb = NULL;
 		spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
 
@@ -674,6 +904,7 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 			break;
 
 		local->total_ps_buffered--;
+		sta->ps_buf_expired++;
 #ifdef CONFIG_MAC80211_VERBOSE_PS_DEBUG
 		printk(KERN_DEBUG "Buffered frame expired (STA %pM)\n",
 		       sta->sta.addr);
@@ -690,7 +921,7 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 
 	/*
 	 * Return whether there are any frames still buffered, this is
-	 * used to check whether the cleanup timer still needs to run,
+	 * used to check whether the expiry timer still needs to run,
 	 * if there are no frames we don't need to rearm the timer.
 	 */
 	return !(skb_queue_empty(&sta->ps_tx_buf[ac]) &&
@@ -714,10 +945,66 @@ static bool sta_info_cleanup_expire_buffered(struct ieee80211_local *local,
 	return have_buffered;
 }
 
+static void sta_info_oldest_queued(struct sk_buff_head *q,
+				   unsigned long *oldest)
+{
+	struct sk_buff *skb;
+	unsigned long flags, queued;
+
+	spin_lock_irqsave(&q->lock, flags);
+	skb = skb_peek(q);
+	if (skb) {
+		queued = IEEE80211_SKB_CB(skb)->control.jiffies;
+		if (time_before(queued, *oldest))
+			*oldest = queued;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+/* Returns the time the oldest frame buffered for @sta was queued at */
+static unsigned long sta_info_oldest_buffered(struct sta_info *sta)
+{
+	unsigned long oldest = jiffies;
+	int ac;
+
+	/*
+	 * A frame can be filtered after newer ones were PS-buffered, so
+	 * either queue may hold the oldest frame.
+	 */
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		sta_info_oldest_queued(&sta->tx_filtered[ac], &oldest);
+		sta_info_oldest_queued(&sta->ps_tx_buf[ac], &oldest);
+	}
+
+	return oldest;
+}
+
+/*
+ * Per-station expiry of buffered frames. Each station with frames buffered
+ * has its timer armed for the oldest one, so only stations that actually
+ * have something to expire are visited.
+ */
+static void sta_info_ps_expire(unsigned long data)
+{
+	struct sta_info *sta = (struct sta_info *) data;
+	struct ieee80211_local *local = sta->local;
+
+	if (!sta_info_cleanup_expire_buffered(local, sta))
+		return;
+
+	if (local->quiescing)
+		return;
+
+	mod_timer(&sta->ps_expire_timer,
+		  round_jiffies_up(sta_info_oldest_buffered(sta) +
+				   sta_info_buffer_timeout(sta)));
+}
+
 static int __must_check __sta_info_destroy(struct sta_info *sta)
 {
 	struct ieee80211_local *local;
 	struct ieee80211_sub_if_data *sdata;
+	struct sk_buff_head buffered;
 	int ret, i, ac;
 	struct tid_ampdu_tx *tid_tx;
 
@@ -790,11 +1077,14 @@ static int __must_check __sta_info_destroy(struct sta_info *sta)
 	 */
 	synchronize_rcu();
 
+	__skb_queue_head_init(&buffered);
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
-		local->total_ps_buffered -= skb_queue_len(&sta->ps_tx_buf[ac]);
-		__skb_queue_purge(&sta->ps_tx_buf[ac]);
-		__skb_queue_purge(&sta->tx_filtered[ac]);
+		sta_ps_buf_splice(sta, ac, &buffered);
+		skb_queue_purge(&sta->tx_filtered[ac]);
 	}
+	local->total_ps_buffered -= skb_queue_len(&buffered);
+	__skb_queue_purge(&buffered);
+	del_timer_sync(&sta->ps_expire_timer);
 
 #ifdef CONFIG_MAC80211_MESH
 	if (ieee80211_vif_is_mesh(&sdata->vif))
@@ -879,41 +1169,15 @@ int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 	return ret;
 }
 
-static void sta_info_cleanup(unsigned long data)
-{
-	struct ieee80211_local *local = (struct ieee80211_local *) data;
-	struct sta_info *sta;
-	bool timer_needed = false;
-
-	rcu_read_lock();
-	list_for_each_entry_rcu(sta, &local->sta_list, list)
-		if (sta_info_cleanup_expire_buffered(local, sta))
-			timer_needed = true;
-	rcu_read_unlock();
-
-	if (local->quiescing)
-		return;
-
-	if (!timer_needed)
-		return;
-
-	mod_timer(&local->sta_cleanup,
-		  round_jiffies(jiffies + STA_INFO_CLEANUP_INTERVAL));
-}
-
 void sta_info_init(struct ieee80211_local *local)
 {
 	spin_lock_init(&local->tim_lock);
 	mutex_init(&local->sta_mtx);
 	INIT_LIST_HEAD(&local->sta_list);
-
-	setup_timer(&local->sta_cleanup, sta_info_cleanup,
-		    (unsigned long)local);
 }
 
 void sta_info_stop(struct ieee80211_local *local)
 {
-	del_timer(&local->sta_cleanup);
 	sta_info_flush(local, NULL);
 }
 
@@ -1018,6 +1282,7 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 	struct ieee80211_local *local = sdata->local;
 	struct sk_buff_head pending;
 	int filtered = 0, buffered = 0, ac;
+	unsigned long flags;
 
 	clear_sta_flag(sta, WLAN_STA_SP);
 
@@ -1033,12 +1298,14 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
 		int count = skb_queue_len(&pending), tmp;
 
+		spin_lock_irqsave(&sta->tx_filtered[ac].lock, flags);
 		skb_queue_splice_tail_init(&sta->tx_filtered[ac], &pending);
+		spin_unlock_irqrestore(&sta->tx_filtered[ac].lock, flags);
 		tmp = skb_queue_len(&pending);
 		filtered += tmp - count;
 		count = tmp;
 
-		skb_queue_splice_tail_init(&sta->ps_tx_buf[ac], &pending);
+		sta_ps_buf_splice(sta, ac, &pending);
 		tmp = skb_queue_len(&pending);
 		buffered += tmp - count;
 	}
@@ -1157,12 +1424,9 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 
 				while (n_frames > 0) {
 					skb = skb_dequeue(&sta->tx_filtered[ac]);
-					if (!skb) {
-						skb = skb_dequeue(
-							&sta->ps_tx_buf[ac]);
-						if (skb)
-							local->total_ps_buffered--;
-					}
+					if (!skb)
+						skb = sta_ps_buf_dequeue(sta,
+									 ac);
 					if (!skb)
 						break;
 					n_frames--;
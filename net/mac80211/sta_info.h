@@ -127,11 +127,22 @@ struct tid_ampdu_tx {
 	bool bar_pending;
 };
 
+/**
+ * struct tid_ampdu_rx_slot - RX reorder buffer slot
+ *
+ * @skb: buffered MPDU
+ * @time: jiffies when @skb was added
+ */
+struct tid_ampdu_rx_slot {
+	struct sk_buff *skb;
+	unsigned long time;
+};
+
 /**
  * struct tid_ampdu_rx - TID aggregation information (Rx).
  *
  * @reorder_buf: buffer to reorder incoming aggregated MPDUs
- * @reorder_time: jiffies when skb was added
+ * @reorder_filled: bitmap of the @reorder_buf slots holding an MPDU
  * @session_timer: check if peer keeps Tx-ing on the TID (by timeout value)
  * @reorder_timer: releases expired frames from the reorder buffer.
  * @head_seq_num: head sequence number in reordering buffer.
@@ -154,8 +165,8 @@ struct tid_ampdu_tx {
 struct tid_ampdu_rx {
 	struct rcu_head rcu_head;
 	spinlock_t reorder_lock;
-	struct sk_buff **reorder_buf;
-	unsigned long *reorder_time;
+	struct tid_ampdu_rx_slot *reorder_buf;
+	unsigned long reorder_filled[BITS_TO_LONGS(IEEE80211_MAX_AMPDU_BUF)];
 	struct timer_list session_timer;
 	struct timer_list reorder_timer;
 	u16 head_seq_num;
@@ -229,6 +240,12 @@ struct sta_ampdu_mlme {
  *	entered power saving state, these are also delivered to
  *	the station when it leaves powersave or polls for frames
  * @driver_buffered_tids: bitmap of TIDs the driver has data buffered on
+ * @ps_buf_bytes: number of bytes (per AC) queued on @ps_tx_buf, protected
+ *	by the respective queue lock
+ * @ps_buf_dropped: number of PS-buffered frames dropped to stay within the
+ *	station's or the global buffer limits
+ * @ps_buf_expired: number of PS-buffered or filtered frames that expired
+ * @ps_expire_timer: fires when the oldest buffered frame expires
  * @rx_packets: Number of MSDUs received from this STA
  * @rx_bytes: Number of bytes received from this STA
  * @wep_weak_iv_count: number of weak WEP IVs received from this station
@@ -259,6 +276,7 @@ struct sta_ampdu_mlme {
  * @plink_timeout: timeout of peer link
  * @plink_timer: peer link watch timer
  * @plink_timer_was_running: used by suspend/resume to restore timers
+ * @mesh_paths: mesh paths using this peer as next hop
  * @debugfs: debug filesystem info
  * @dead: set to true when sta is unlinked
  * @uploaded: set to true when sta is uploaded to the driver
@@ -298,6 +316,9 @@ struct sta_info {
 	struct sk_buff_head ps_tx_buf[IEEE80211_NUM_ACS];
 	struct sk_buff_head tx_filtered[IEEE80211_NUM_ACS];
 	unsigned long driver_buffered_tids;
+	unsigned int ps_buf_bytes[IEEE80211_NUM_ACS];
+	unsigned long ps_buf_dropped, ps_buf_expired;
+	struct timer_list ps_expire_timer;
 
 	/* Updated from RX path only, no locking requirements */
 	unsigned long rx_packets, rx_bytes;
@@ -347,6 +368,7 @@ struct sta_info {
 	enum nl80211_plink_state plink_state;
 	u32 plink_timeout;
 	struct timer_list plink_timer;
+	struct list_head mesh_paths;
 #endif
 
 #ifdef CONFIG_MAC80211_DEBUGFS
@@ -445,14 +467,16 @@ rcu_dereference_protected_tid_tx(struct sta_info *sta, int tid)
 /* Maximum number of frames to buffer per power saving station per AC */
 #define STA_MAX_TX_BUFFER	64
 
+/* Maximum number of bytes to buffer per power saving station per AC */
+#define STA_MAX_TX_BUFFER_AC_BYTES	(64 * 1024)
+
+/* Maximum number of bytes to buffer per power saving station in total */
+#define STA_MAX_TX_BUFFER_BYTES		(128 * 1024)
+
 /* Minimum buffered frame expiry time. If STA uses listen interval that is
  * smaller than this value, the minimum value here is used instead. */
 #define STA_TX_BUFFER_EXPIRE (10 * HZ)
 
-/* How often station data is cleaned up (e.g., expiration of buffered frames)
- */
-#define STA_INFO_CLEANUP_INTERVAL (10 * HZ)
-
 /*
  * Get a STA info, must be under RCU read lock.
  */
@@ -508,7 +532,8 @@ void for_each_sta_info_type_check(struct ieee80211_local *local,
 	if (memcmp(_sta->sta.addr, (_addr), ETH_ALEN) == 0)
 
 /*
- * Get STA info by index, BROKEN!
+ * Get STA info by index, BROKEN! Must be called under RTNL, it keeps
+ * a per-interface cursor to make sequential dumps linear.
  */
 struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 				     int idx);
@@ -540,6 +565,13 @@ int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 
 void sta_info_recalc_tim(struct sta_info *sta);
 
+void sta_ps_buf_enqueue(struct sta_info *sta, int ac, struct sk_buff *skb);
+struct sk_buff *sta_ps_buf_dequeue(struct sta_info *sta, int ac);
+void sta_ps_buf_make_room(struct sta_info *sta, int ac, unsigned int len);
+bool sta_ps_buf_drop_oldest(struct sta_info *sta);
+unsigned int sta_ps_buf_frames(struct sta_info *sta);
+void sta_info_ps_arm_expiry(struct sta_info *sta);
+
 void sta_info_init(struct ieee80211_local *local);
 void sta_info_stop(struct ieee80211_local *local);
 int sta_info_flush(struct ieee80211_local *local,
@@ -11,15 +11,16 @@
 #include <linux/types.h>
 #include <linux/netdevice.h>
 #include <linux/export.h>
+#include <linux/crc32.h>
 #include <asm/unaligned.h>
 
 #include <net/mac80211.h>
 #include "driver-ops.h"
 #include "key.h"
 #include "tkip.h"
-#include "wep.h"
 
 #define PHASE1_LOOP_COUNT 8
+#define TKIP_RC4_KEY_LEN 16
 
 /*
  * 2-byte by 2-byte subset of the full AES S-box table; second part of this
@@ -217,6 +218,55 @@ void ieee80211_get_tkip_p2k(struct ieee80211_key_conf *keyconf,
 }
 EXPORT_SYMBOL(ieee80211_get_tkip_p2k);
 
+/*
+ * RC4 for the per-packet TKIP key. Going through the "arc4" crypto_cipher
+ * costs an indirect call per byte (it has a block size of one), which
+ * dominates software TKIP; run the key schedule and the keystream over
+ * the whole payload locally instead.
+ */
+struct tkip_rc4 {
+	u8 s[256];
+	u8 x, y;
+};
+
+static void tkip_rc4_init(struct tkip_rc4 *rc4, const u8 *rc4key)
+{
+	u8 j = 0, t;
+	int i;
+
+	for (i = 0; i < 256; i++)
+		rc4->s[i] = i;
+
+	for (i = 0; i < 256; i++) {
+		t = rc4->s[i];
+		j += t + rc4key[i & (TKIP_RC4_KEY_LEN - 1)];
+		rc4->s[i] = rc4->s[j];
+		rc4->s[j] = t;
+	}
+
+	rc4->x = 0;
+	rc4->y = 0;
+}
+
+static void tkip_rc4_crypt(struct tkip_rc4 *rc4, u8 *data, size_t len)
+{
+	u8 *s = rc4->s;
+	u8 x = rc4->x, y = rc4->y, a, b;
+
+	while (len--) {
+		x++;
+		a = s[x];
+		y += a;
+		b = s[y];
+		s[x] = b;
+		s[y] = a;
+		*data++ ^= s[(u8)(a + b)];
+	}
+
+	rc4->x = x;
+	rc4->y = y;
+}
+
 /*
  * Encrypt packet payload with TKIP using @key. @pos is a pointer to the
  * beginning of the buffer containing payload. This payload must include
@@ -224,32 +274,39 @@ EXPORT_SYMBOL(ieee80211_get_tkip_p2k);
  * @payload_len is the length of payload (_not_ including IV/ICV length).
  * @ta is the transmitter addresses.
  */
-int ieee80211_tkip_encrypt_data(struct crypto_cipher *tfm,
-				struct ieee80211_key *key,
+int ieee80211_tkip_encrypt_data(struct ieee80211_key *key,
 				struct sk_buff *skb,
 				u8 *payload, size_t payload_len)
 {
-	u8 rc4key[16];
+	u8 rc4key[TKIP_RC4_KEY_LEN];
+	struct tkip_rc4 rc4;
+	__le32 icv;
 
 	ieee80211_get_tkip_p2k(&key->conf, skb, rc4key);
 
-	return ieee80211_wep_encrypt_data(tfm, rc4key, 16,
-					  payload, payload_len);
+	icv = cpu_to_le32(~crc32_le(~0, payload, payload_len));
+	put_unaligned(icv, (__le32 *)(payload + payload_len));
+
+	tkip_rc4_init(&rc4, rc4key);
+	tkip_rc4_crypt(&rc4, payload, payload_len + TKIP_ICV_LEN);
+
+	return 0;
 }
 
 /* Decrypt packet payload with TKIP using @key. @pos is a pointer to the
  * beginning of the buffer containing IEEE 802.11 header payload, i.e.,
  * including IV, Ext. IV, real data, Michael MIC, ICV. @payload_len is the
  * length of payload, including IV, Ext. IV, MIC, ICV.  */
-int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
-				struct ieee80211_key *key,
+int ieee80211_tkip_decrypt_data(struct ieee80211_key *key,
 				u8 *payload, size_t payload_len, u8 *ta,
 				u8 *ra, int only_iv, int queue,
 				u32 *out_iv32, u16 *out_iv16)
 {
 	u32 iv32;
 	u32 iv16;
-	u8 rc4key[16], keyid, *pos = payload;
+	u8 rc4key[TKIP_RC4_KEY_LEN], keyid, *pos = payload;
+	struct tkip_rc4 rc4;
+	__le32 crc;
 	int res;
 	const u8 *tk = &key->conf.key[NL80211_TKIP_DATA_OFFSET_ENCR_KEY];
 
@@ -343,7 +400,14 @@ int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
 	}
 #endif
 
-	res = ieee80211_wep_decrypt_data(tfm, rc4key, 16, pos, payload_len - 12);
+	tkip_rc4_init(&rc4, rc4key);
+	tkip_rc4_crypt(&rc4, pos, payload_len - TKIP_IV_LEN);
+
+	res = TKIP_DECRYPT_OK;
+	crc = cpu_to_le32(~crc32_le(~0, pos, payload_len - 12));
+	if (memcmp(&crc, pos + payload_len - 12, TKIP_ICV_LEN) != 0)
+		/* ICV mismatch */
+		res = -1;
  done:
 	if (res == TKIP_DECRYPT_OK) {
 		/*
@@ -10,13 +10,11 @@
 #define TKIP_H
 
 #include <linux/types.h>
-#include <linux/crypto.h>
 #include "key.h"
 
 u8 *ieee80211_tkip_add_iv(u8 *pos, struct ieee80211_key *key);
 
-int ieee80211_tkip_encrypt_data(struct crypto_cipher *tfm,
-				struct ieee80211_key *key,
+int ieee80211_tkip_encrypt_data(struct ieee80211_key *key,
 				struct sk_buff *skb,
 				u8 *payload, size_t payload_len);
 
@@ -26,8 +24,7 @@ enum {
 	TKIP_DECRYPT_INVALID_KEYIDX = -2,
 	TKIP_DECRYPT_REPLAY = -3,
 };
-int ieee80211_tkip_decrypt_data(struct crypto_cipher *tfm,
-				struct ieee80211_key *key,
+int ieee80211_tkip_decrypt_data(struct ieee80211_key *key,
 				u8 *payload, size_t payload_len, u8 *ta,
 				u8 *ra, int only_iv, int queue,
 				u32 *out_iv32, u16 *out_iv16);
@@ -351,17 +351,9 @@ static void purge_old_ps_buffers(struct ieee80211_local *local)
 	 * AC that has frames at all.
 	 */
 	list_for_each_entry_rcu(sta, &local->sta_list, list) {
-		int ac;
-
-		for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO; ac--) {
-			skb = skb_dequeue(&sta->ps_tx_buf[ac]);
-			total += skb_queue_len(&sta->ps_tx_buf[ac]);
-			if (skb) {
-				purged++;
-				dev_kfree_skb(skb);
-				break;
-			}
-		}
+		if (sta_ps_buf_drop_oldest(sta))
+			purged++;
+		total += sta_ps_buf_frames(sta);
 	}
 
 	rcu_read_unlock();
@@ -464,29 +456,36 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 		printk(KERN_DEBUG "STA %pM aid %d: PS buffer for AC %d\n",
 		       sta->sta.addr, sta->sta.aid, ac);
 #endif /* CONFIG_MAC80211_VERBOSE_PS_DEBUG */
-		if (tx->local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER)
-			purge_old_ps_buffers(tx->local);
-		if (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER) {
-			struct sk_buff *old = skb_dequeue(&sta->ps_tx_buf[ac]);
+		/* stay within this station's own frame and byte budgets */
+		sta_ps_buf_make_room(sta, ac, tx->skb->len);
+
+		/*
+		 * If all buffers are in use, a station holding at least its
+		 * fair share pays for its new frame with one of its own.
+		 * Only otherwise do we take frames from everybody else.
+		 */
+		if (local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER) {
+			int num_ps = tx->sdata->bss ?
+				atomic_read(&tx->sdata->bss->num_sta_ps) : 0;
+
+			if (sta_ps_buf_frames(sta) <
+			    TOTAL_MAX_TX_BUFFER / max(num_ps, 1) ||
+			    !sta_ps_buf_drop_oldest(sta))
+				purge_old_ps_buffers(local);
 #ifdef CONFIG_MAC80211_VERBOSE_PS_DEBUG
-			if (net_ratelimit())
-				printk(KERN_DEBUG "%s: STA %pM TX buffer for "
-				       "AC %d full - dropping oldest frame\n",
-				       tx->sdata->name, sta->sta.addr, ac);
+			else if (net_ratelimit())
+				printk(KERN_DEBUG "%s: STA %pM over its share "
+				       "of PS buffers - dropping oldest frame\n",
+				       tx->sdata->name, sta->sta.addr);
 #endif
-			dev_kfree_skb(old);
-		} else
-			tx->local->total_ps_buffered++;
+		}
 
 		info->control.jiffies = jiffies;
 		info->control.vif = &tx->sdata->vif;
 		info->flags |= IEEE80211_TX_INTFL_NEED_TXPROCESSING;
-		skb_queue_tail(&sta->ps_tx_buf[ac], tx->skb);
+		sta_ps_buf_enqueue(sta, ac, tx->skb);
 
-		if (!timer_pending(&local->sta_cleanup))
-			mod_timer(&local->sta_cleanup,
-				  round_jiffies(jiffies +
-						STA_INFO_CLEANUP_INTERVAL));
+		sta_info_ps_arm_expiry(sta);
 
 		/*
 		 * We queued up some frames, so the TIM bit might
@@ -1692,6 +1691,52 @@ fail:
  * encapsulated packet will then be passed to master interface, wlan#.11, for
  * transmission (through low-level driver).
  */
+/*
+ * Segment a GSO frame whose 802.11 (and LLC/mesh) headers have already
+ * been built. The GSO code replicates everything in front of the network
+ * header, so every segment carries a complete copy of the headers and of
+ * the tx info and then goes through the tx handlers on its own.
+ *
+ * TSO is only enabled together with IP checksum offload, so segment with
+ * SG and IP_CSUM: the segments keep CHECKSUM_PARTIAL for the driver to
+ * offload, and are linearized here since drivers expect linear frames.
+ */
+static void ieee80211_xmit_gso(struct ieee80211_sub_if_data *sdata,
+			       struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info;
+	struct sk_buff *segs, *next;
+
+	segs = skb_gso_segment(skb, NETIF_F_SG | NETIF_F_IP_CSUM);
+	if (IS_ERR_OR_NULL(segs)) {
+		dev_kfree_skb(skb);
+		return;
+	}
+
+	consume_skb(skb);
+
+	while (segs) {
+		next = segs->next;
+		segs->next = NULL;
+
+		if (skb_linearize(segs)) {
+			dev_kfree_skb(segs);
+			segs = next;
+			continue;
+		}
+
+		/* only the last segment reports status if it was requested */
+		if (next) {
+			info = IEEE80211_SKB_CB(segs);
+			info->flags &= ~IEEE80211_TX_CTL_REQ_TX_STATUS;
+			info->ack_frame_id = 0;
+		}
+
+		ieee80211_xmit(sdata, segs);
+		segs = next;
+	}
+}
+
 netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 				    struct net_device *dev)
 {
@@ -1998,6 +2043,15 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 		}
 	}
 
+	/*
+	 * Drivers only ever see linear frames. GSO frames are segmented
+	 * into linear ones once their 802.11 header has been built.
+	 */
+	if (!skb_is_gso(skb) && skb_linearize(skb)) {
+		ret = NETDEV_TX_OK;
+		goto fail;
+	}
+
 	hdr.frame_control = fc;
 	hdr.duration_id = 0;
 	hdr.seq_ctrl = 0;
@@ -2093,7 +2147,10 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 	info->flags = info_flags;
 	info->ack_frame_id = info_id;
 
-	ieee80211_xmit(sdata, skb);
+	if (skb_is_gso(skb))
+		ieee80211_xmit_gso(sdata, skb);
+	else
+		ieee80211_xmit(sdata, skb);
 
 	return NETDEV_TX_OK;
 
@@ -2209,15 +2266,13 @@ static void ieee80211_beacon_add_tim(struct ieee80211_if_ap *bss,
 {
 	u8 *pos, *tim;
 	int aid0 = 0;
-	int i, have_bits = 0, n1, n2;
+	int have_bits = 0, n1, n2;
 
 	/* Generate bitmap for TIM only if there are any STAs in power save
-	 * mode. */
+	 * mode. The set AIDs and their bounds are tracked by
+	 * __bss_tim_set()/__bss_tim_clear(), so no need to scan the bitmap. */
 	if (atomic_read(&bss->num_sta_ps) > 0)
-		/* in the hope that this is faster than
-		 * checking byte-for-byte */
-		have_bits = !bitmap_empty((unsigned long*)bss->tim,
-					  IEEE80211_MAX_AID+1);
+		have_bits = bss->tim_aids != 0;
 
 	if (bss->dtim_count == 0)
 		bss->dtim_count = beacon->dtim_period - 1;
@@ -2239,20 +2294,8 @@ static void ieee80211_beacon_add_tim(struct ieee80211_if_ap *bss,
 		/* Find largest even number N1 so that bits numbered 1 through
 		 * (N1 x 8) - 1 in the bitmap are 0 and number N2 so that bits
 		 * (N2 + 1) x 8 through 2007 are 0. */
-		n1 = 0;
-		for (i = 0; i < IEEE80211_MAX_TIM_LEN; i++) {
-			if (bss->tim[i]) {
-				n1 = i & 0xfe;
-				break;
-			}
-		}
-		n2 = n1;
-		for (i = IEEE80211_MAX_TIM_LEN - 1; i >= n1; i--) {
-			if (bss->tim[i]) {
-				n2 = i;
-				break;
-			}
-		}
+		n1 = bss->tim_first & 0xfe;
+		n2 = bss->tim_last;
 
 		/* Bitmap control */
 		*pos++ = n1 | aid0;
@@ -2267,6 +2310,18 @@ static void ieee80211_beacon_add_tim(struct ieee80211_if_ap *bss,
 	}
 }
 
+u32 ieee80211_beacon_get_gen(struct ieee80211_vif *vif)
+{
+	struct ieee80211_sub_if_data *sdata = vif_to_sdata(vif);
+
+	/* mesh beacons are built from the current mesh state every time */
+	if (ieee80211_vif_is_mesh(vif))
+		return 0;
+
+	return ACCESS_ONCE(sdata->beacon_gen);
+}
+EXPORT_SYMBOL(ieee80211_beacon_get_gen);
+
 struct sk_buff *ieee80211_beacon_get_tim(struct ieee80211_hw *hw,
 					 struct ieee80211_vif *vif,
 					 u16 *tim_offset, u16 *tim_length)
@@ -565,6 +565,57 @@ void ieee80211_queue_delayed_work(struct ieee80211_hw *hw,
 }
 EXPORT_SYMBOL(ieee80211_queue_delayed_work);
 
+static u32 ieee802_11_elem_crc(u8 id, u8 *pos, u8 elen, u64 filter, u32 crc)
+{
+	if (id < 64 && (filter & (1ULL << id)))
+		return crc32_be(crc, pos - 2, elen + 2);
+
+	/* Microsoft OUI (00:50:F2) vendor elements are always included */
+	if (id == WLAN_EID_VENDOR_SPECIFIC && elen >= 4 &&
+	    pos[0] == 0x00 && pos[1] == 0x50 && pos[2] == 0xf2)
+		return crc32_be(crc, pos - 2, elen + 2);
+
+	return crc;
+}
+
+/*
+ * Compute the same CRC as ieee802_11_parse_elems_crc() does for @filter,
+ * and look up the TIM element, without parsing the other elements.
+ */
+u32 ieee802_11_elems_crc(u8 *start, size_t len, u64 filter, u32 crc,
+			 struct ieee80211_tim_ie **tim, u8 *tim_len)
+{
+	size_t left = len;
+	u8 *pos = start;
+
+	*tim = NULL;
+	*tim_len = 0;
+
+	while (left >= 2) {
+		u8 id, elen;
+
+		id = *pos++;
+		elen = *pos++;
+		left -= 2;
+
+		if (elen > left)
+			break;
+
+		crc = ieee802_11_elem_crc(id, pos, elen, filter, crc);
+
+		if (id == WLAN_EID_TIM &&
+		    elen >= sizeof(struct ieee80211_tim_ie)) {
+			*tim = (void *)pos;
+			*tim_len = elen;
+		}
+
+		left -= elen;
+		pos += elen;
+	}
+
+	return crc;
+}
+
 u32 ieee802_11_parse_elems_crc(u8 *start, size_t len,
 			       struct ieee802_11_elems *elems,
 			       u64 filter, u32 crc)
@@ -587,8 +638,8 @@ u32 ieee802_11_parse_elems_crc(u8 *start, size_t len,
 		if (elen > left)
 			break;
 
-		if (calc_crc && id < 64 && (filter & (1ULL << id)))
-			crc = crc32_be(crc, pos - 2, elen + 2);
+		if (calc_crc)
+			crc = ieee802_11_elem_crc(id, pos, elen, filter, crc);
 
 		switch (id) {
 		case WLAN_EID_SSID:
@@ -630,9 +681,6 @@ u32 ieee802_11_parse_elems_crc(u8 *start, size_t len,
 			    pos[2] == 0xf2) {
 				/* Microsoft OUI (00:50:F2) */
 
-				if (calc_crc)
-					crc = crc32_be(crc, pos - 2, elen + 2);
-
 				if (pos[3] == 1) {
 					/* OUI Type 1 - WPA IE */
 					elems->wpa = pos;
@@ -1352,11 +1400,12 @@ int ieee80211_reconfig(struct ieee80211_local *local)
 		}
 	}
 
-	mod_timer(&local->sta_cleanup, jiffies + 1);
-
 	mutex_lock(&local->sta_mtx);
-	list_for_each_entry(sta, &local->sta_list, list)
+	list_for_each_entry(sta, &local->sta_list, list) {
+		/* expire whatever got too old while we were suspended */
+		mod_timer(&sta->ps_expire_timer, jiffies + 1);
 		mesh_plink_restart(sta);
+	}
 	mutex_unlock(&local->sta_mtx);
 #else
 	WARN_ON(1);
@@ -17,6 +17,8 @@
 #include <net/cfg80211.h>
 #include "reg.h"
 
+#define CFG80211_BSS_HASH_SIZE	256
+
 struct cfg80211_registered_device {
 	const struct cfg80211_ops *ops;
 	struct list_head list;
@@ -58,8 +60,10 @@ struct cfg80211_registered_device {
 
 	/* BSSes/scanning */
 	spinlock_t bss_lock;
-	struct list_head bss_list;
+	struct list_head bss_list; /* oldest entry first */
 	struct rb_root bss_tree;
+	struct hlist_head bss_hash[CFG80211_BSS_HASH_SIZE];
+	unsigned int bss_entries;
 	u32 bss_generation;
 	struct cfg80211_scan_request *scan_req; /* protected by RTNL */
 	struct cfg80211_sched_scan_request *sched_scan_req;
@@ -133,6 +137,7 @@ static inline void assert_cfg80211_lock(void)
 struct cfg80211_internal_bss {
 	struct list_head list;
 	struct rb_node rbn;
+	struct hlist_node hnode;
 	unsigned long ts;
 	struct kref ref;
 	atomic_t hold;
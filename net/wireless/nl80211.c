@@ -211,6 +211,7 @@ static const struct nla_policy nl80211_policy[NL80211_ATTR_MAX+1] = {
 	[NL80211_ATTR_SCHED_SCAN_SHORT_INTERVAL] = { .type = NLA_U32 },
 	[NL80211_ATTR_SCHED_SCAN_NUM_SHORT_INTERVALS] = { .type = NLA_U8 },
 	[NL80211_ATTR_ROAMING_DISABLED] = { .type = NLA_FLAG },
+	[NL80211_ATTR_STA_STATS_ONLY] = { .type = NLA_FLAG },
 };
 
 /* policy for the key attributes */
@@ -2460,6 +2461,19 @@ static int nl80211_send_station(struct sk_buff *msg, u32 pid, u32 seq,
 	return -EMSGSIZE;
 }
 
+/* what NL80211_ATTR_STA_STATS_ONLY dumps report */
+#define NL80211_STA_STATS_ONLY_FILLED	(STATION_INFO_INACTIVE_TIME |	\
+					 STATION_INFO_CONNECTED_TIME |	\
+					 STATION_INFO_RX_BYTES |	\
+					 STATION_INFO_TX_BYTES |	\
+					 STATION_INFO_RX_PACKETS |	\
+					 STATION_INFO_TX_PACKETS |	\
+					 STATION_INFO_TX_RETRIES |	\
+					 STATION_INFO_TX_FAILED |	\
+					 STATION_INFO_SIGNAL |		\
+					 STATION_INFO_SIGNAL_AVG |	\
+					 STATION_INFO_BEACON_LOSS_COUNT)
+
 static int nl80211_dump_station(struct sk_buff *skb,
 				struct netlink_callback *cb)
 {
@@ -2468,12 +2482,17 @@ static int nl80211_dump_station(struct sk_buff *skb,
 	struct net_device *netdev;
 	u8 mac_addr[ETH_ALEN];
 	int sta_idx = cb->args[1];
+	bool first = !cb->args[0];
 	int err;
 
 	err = nl80211_prepare_netdev_dump(skb, cb, &dev, &netdev);
 	if (err)
 		return err;
 
+	/* the request attributes were only parsed on the first call */
+	if (first && nl80211_fam.attrbuf[NL80211_ATTR_STA_STATS_ONLY])
+		cb->args[2] = 1;
+
 	if (!dev->ops->dump_station) {
 		err = -EOPNOTSUPP;
 		goto out_err;
@@ -2488,6 +2507,9 @@ static int nl80211_dump_station(struct sk_buff *skb,
 		if (err)
 			goto out_err;
 
+		if (cb->args[2])
+			sinfo.filled &= NL80211_STA_STATS_ONLY_FILLED;
+
 		if (nl80211_send_station(skb,
 				NETLINK_CB(cb->skb).pid,
 				cb->nlh->nlmsg_seq, NLM_F_MULTI,
@@ -4221,7 +4243,7 @@ static int nl80211_dump_scan(struct sk_buff *skb,
 {
 	struct cfg80211_registered_device *rdev;
 	struct net_device *dev;
-	struct cfg80211_internal_bss *scan;
+	struct cfg80211_internal_bss *scan, *last;
 	struct wireless_dev *wdev;
 	int start = cb->args[1], idx = 0;
 	int err;
@@ -4238,17 +4260,46 @@ static int nl80211_dump_scan(struct sk_buff *skb,
 
 	cb->seq = rdev->bss_generation;
 
-	list_for_each_entry(scan, &rdev->bss_list, list) {
-		if (++idx <= start)
-			continue;
-		if (nl80211_send_bss(skb, cb,
-				cb->nlh->nlmsg_seq, NLM_F_MULTI,
-				rdev, wdev, scan) < 0) {
-			idx--;
-			break;
+	/*
+	 * Every change to the BSS list bumps bss_generation, so if it is
+	 * unchanged since the previous chunk the last entry we got to is
+	 * still linked and we can continue right after it, rather than
+	 * skipping over everything already sent again.
+	 */
+	last = (struct cfg80211_internal_bss *)cb->args[2];
+	if (last && cb->args[3] == rdev->bss_generation &&
+	    cb->args[4] == rdev->wiphy_idx) {
+		idx = start;
+		scan = last;
+		list_for_each_entry_continue(scan, &rdev->bss_list, list) {
+			if (nl80211_send_bss(skb, cb,
+					cb->nlh->nlmsg_seq, NLM_F_MULTI,
+					rdev, wdev, scan) < 0)
+				break;
+			last = scan;
+			idx++;
+		}
+	} else {
+		last = NULL;
+		list_for_each_entry(scan, &rdev->bss_list, list) {
+			if (++idx <= start) {
+				last = scan;
+				continue;
+			}
+			if (nl80211_send_bss(skb, cb,
+					cb->nlh->nlmsg_seq, NLM_F_MULTI,
+					rdev, wdev, scan) < 0) {
+				idx--;
+				break;
+			}
+			last = scan;
 		}
 	}
 
+	cb->args[2] = (long)last;
+	cb->args[3] = rdev->bss_generation;
+	cb->args[4] = rdev->wiphy_idx;
+
 	spin_unlock_bh(&rdev->bss_lock);
 	wdev_unlock(wdev);
 
@@ -10,6 +10,7 @@
 #include <linux/wireless.h>
 #include <linux/nl80211.h>
 #include <linux/etherdevice.h>
+#include <linux/jhash.h>
 #include <net/arp.h>
 #include <net/cfg80211.h>
 #include <net/cfg80211-wext.h>
@@ -20,6 +21,18 @@
 
 #define IEEE80211_SCAN_RESULT_EXPIRE	(15 * HZ)
 
+static unsigned int bss_entries_limit = 1000;
+module_param(bss_entries_limit, uint, 0644);
+MODULE_PARM_DESC(bss_entries_limit,
+		 "limit to number of scan BSS entries (per wiphy, default 1000)");
+
+static inline struct hlist_head *
+bss_hash_head(struct cfg80211_registered_device *dev, const u8 *bssid)
+{
+	return &dev->bss_hash[jhash(bssid, ETH_ALEN, 0) %
+			      CFG80211_BSS_HASH_SIZE];
+}
+
 void ___cfg80211_scan_done(struct cfg80211_registered_device *rdev, bool leak)
 {
 	struct cfg80211_scan_request *request;
@@ -254,6 +267,8 @@ static void __cfg80211_unlink_bss(struct cfg80211_registered_device *dev,
 {
 	list_del_init(&bss->list);
 	rb_erase(&bss->rbn, &dev->bss_tree);
+	hlist_del_init(&bss->hnode);
+	dev->bss_entries--;
 	kref_put(&bss->ref, bss_release);
 }
 
@@ -263,11 +278,15 @@ void cfg80211_bss_expire(struct cfg80211_registered_device *dev)
 	struct cfg80211_internal_bss *bss, *tmp;
 	bool expired = false;
 
+	/*
+	 * The list is kept in order of last update, so everything after
+	 * the first unexpired entry is unexpired as well.
+	 */
 	list_for_each_entry_safe(bss, tmp, &dev->bss_list, list) {
 		if (atomic_read(&bss->hold))
 			continue;
 		if (!time_after(jiffies, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE))
-			continue;
+			break;
 		__cfg80211_unlink_bss(dev, bss);
 		expired = true;
 	}
@@ -276,6 +295,21 @@ void cfg80211_bss_expire(struct cfg80211_registered_device *dev)
 		dev->bss_generation++;
 }
 
+/* must hold dev->bss_lock! */
+static bool cfg80211_bss_expire_oldest(struct cfg80211_registered_device *dev)
+{
+	struct cfg80211_internal_bss *bss;
+
+	list_for_each_entry(bss, &dev->bss_list, list) {
+		if (atomic_read(&bss->hold))
+			continue;
+		__cfg80211_unlink_bss(dev, bss);
+		return true;
+	}
+
+	return false;
+}
+
 const u8 *cfg80211_find_ie(u8 eid, const u8 *ies, int len)
 {
 	while (len > 2 && ies[0] != eid) {
@@ -505,6 +539,24 @@ static int cmp_hidden_bss(struct cfg80211_bss *a,
 	return 0;
 }
 
+static bool cfg80211_bss_match(struct cfg80211_internal_bss *bss,
+			       struct ieee80211_channel *channel,
+			       const u8 *bssid,
+			       const u8 *ssid, size_t ssid_len,
+			       u16 capa_mask, u16 capa_val,
+			       unsigned long now)
+{
+	if ((bss->pub.capability & capa_mask) != capa_val)
+		return false;
+	if (channel && bss->pub.channel != channel)
+		return false;
+	/* Don't get expired BSS structs */
+	if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
+	    !atomic_read(&bss->hold))
+		return false;
+	return is_bss(&bss->pub, bssid, ssid, ssid_len);
+}
+
 struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 				      struct ieee80211_channel *channel,
 				      const u8 *bssid,
@@ -513,26 +565,35 @@ struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 {
 	struct cfg80211_registered_device *dev = wiphy_to_dev(wiphy);
 	struct cfg80211_internal_bss *bss, *res = NULL;
+	struct hlist_node *node;
 	unsigned long now = jiffies;
 
 	spin_lock_bh(&dev->bss_lock);
 
-	list_for_each_entry(bss, &dev->bss_list, list) {
-		if ((bss->pub.capability & capa_mask) != capa_val)
-			continue;
-		if (channel && bss->pub.channel != channel)
-			continue;
-		/* Don't get expired BSS structs */
-		if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
-		    !atomic_read(&bss->hold))
-			continue;
-		if (is_bss(&bss->pub, bssid, ssid, ssid_len)) {
-			res = bss;
-			kref_get(&res->ref);
-			break;
+	if (bssid) {
+		hlist_for_each_entry(bss, node, bss_hash_head(dev, bssid),
+				     hnode) {
+			if (cfg80211_bss_match(bss, channel, bssid,
+					       ssid, ssid_len,
+					       capa_mask, capa_val, now)) {
+				res = bss;
+				break;
+			}
+		}
+	} else {
+		list_for_each_entry(bss, &dev->bss_list, list) {
+			if (cfg80211_bss_match(bss, channel, bssid,
+					       ssid, ssid_len,
+					       capa_mask, capa_val, now)) {
+				res = bss;
+				break;
+			}
 		}
 	}
 
+	if (res)
+		kref_get(&res->ref);
+
 	spin_unlock_bh(&dev->bss_lock);
 	if (!res)
 		return NULL;
@@ -677,10 +738,11 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		return NULL;
 	}
 
-	res->ts = jiffies;
-
 	spin_lock_bh(&dev->bss_lock);
 
+	/* taken under the lock to keep bss_list ordered by timestamp */
+	res->ts = jiffies;
+
 	found = rb_find_bss(dev, res);
 
 	if (found) {
@@ -689,6 +751,7 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		found->pub.signal = res->pub.signal;
 		found->pub.capability = res->pub.capability;
 		found->ts = res->ts;
+		list_move_tail(&found->list, &dev->bss_list);
 
 		/* Update IEs */
 		if (res->pub.proberesp_ies) {
@@ -780,9 +843,20 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		if (hidden)
 			copy_hidden_ies(res, hidden);
 
+		/* make room by dropping the least recently updated entry */
+		if (bss_entries_limit &&
+		    dev->bss_entries >= bss_entries_limit &&
+		    !cfg80211_bss_expire_oldest(dev)) {
+			spin_unlock_bh(&dev->bss_lock);
+			kref_put(&res->ref, bss_release);
+			return NULL;
+		}
+
 		/* this "consumes" the reference */
 		list_add_tail(&res->list, &dev->bss_list);
 		rb_insert_bss(dev, res);
+		hlist_add_head(&res->hnode, bss_hash_head(dev, res->pub.bssid));
+		dev->bss_entries++;
 		found = res;
 	}
 
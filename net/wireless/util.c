@@ -535,6 +535,77 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
 }
 EXPORT_SYMBOL(ieee80211_data_from_8023);
 
+#define IEEE80211_AMSDU_SHARE_MIN_LEN	256
+
+static bool ieee80211_amsdu_subframe_shareable(struct sk_buff *skb,
+					       unsigned int len,
+					       unsigned int extra_headroom)
+{
+	/*
+	 * Small subframes are cheaper to copy than to let them pin the
+	 * whole A-MSDU buffer until they are consumed.
+	 */
+	if (len < IEEE80211_AMSDU_SHARE_MIN_LEN)
+		return false;
+
+	if (skb_is_nonlinear(skb) ||
+	    skb_headroom(skb) < extra_headroom + sizeof(struct ethhdr))
+		return false;
+
+#ifndef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
+	{
+		const u8 *nh = skb->data;
+
+		/* network header follows the RFC1042/bridge-tunnel header */
+		if (len >= 8 &&
+		    (compare_ether_addr(nh, rfc1042_header) == 0 ||
+		     compare_ether_addr(nh, bridge_tunnel_header) == 0))
+			nh += 8;
+
+		if (!IS_ALIGNED((unsigned long)nh, 4))
+			return false;
+	}
+#endif
+
+	return true;
+}
+
+/*
+ * Subframes whose payload is suitably aligned can share the A-MSDU
+ * buffer through a clone instead of being copied out. Only the
+ * subframe's own header area gets rewritten when it is converted to
+ * 802.3, and the parent has already been pulled past it by then.
+ * A clone keeps the truesize of the whole A-MSDU, since it pins the
+ * whole buffer for as long as it lives.
+ */
+static struct sk_buff *
+ieee80211_amsdu_subframe(struct sk_buff *skb, unsigned int len,
+			 unsigned int extra_headroom)
+{
+	unsigned int hlen = ALIGN(extra_headroom, 4);
+	struct sk_buff *frame;
+
+	if (ieee80211_amsdu_subframe_shareable(skb, len, extra_headroom)) {
+		frame = skb_clone(skb, GFP_ATOMIC);
+		if (frame) {
+			skb_trim(frame, len);
+			return frame;
+		}
+	}
+
+	/*
+	 * Allocate and reserve two bytes more for payload
+	 * alignment since sizeof(struct ethhdr) is 14.
+	 */
+	frame = dev_alloc_skb(hlen + sizeof(struct ethhdr) + len + 2);
+	if (!frame)
+		return NULL;
+
+	skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
+	memcpy(skb_put(frame, len), skb->data, len);
+
+	return frame;
+}
 
 void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			      const u8 *addr, enum nl80211_iftype iftype,
@@ -580,19 +651,11 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 		if (remaining <= subframe_len + padding)
 			frame = skb;
 		else {
-			unsigned int hlen = ALIGN(extra_headroom, 4);
-			/*
-			 * Allocate and reserve two bytes more for payload
-			 * alignment since sizeof(struct ethhdr) is 14.
-			 */
-			frame = dev_alloc_skb(hlen + subframe_len + 2);
+			frame = ieee80211_amsdu_subframe(skb, ntohs(len),
+							 extra_headroom);
 			if (!frame)
 				goto purge;
 
-			skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
-			memcpy(skb_put(frame, ntohs(len)), skb->data,
-				ntohs(len));
-
 			eth = (struct ethhdr *)skb_pull(skb, ntohs(len) +
 							padding);
 			if (!eth) {